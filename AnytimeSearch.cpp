@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* The number of combinations given out from a region the first time it is
+ * picked, and the most given out from it at once later. In between, picking
+ * a region gives out as many as have been tried in it so far, so that a
+ * region is given out in larger pieces the more its estimate is trusted. */
+const static long AnytimeProbe = 100;
+const static long AnytimeChunk = 10000;
+
+/* The nanoseconds between saves of the progress while searching. */
+const static long CheckpointNanoseconds = 60000000000;
+
+/* The current time on the steady clock, in nanoseconds. */
+static long steadyNanoseconds(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Picks the region to give out from next. Regions are probed in order
+ * until each has been given out from once. After that, the hits of a
+ * region are treated as a Poisson count, and the region picked is the one
+ * whose upper confidence bound on them, divided by the time its tried
+ * combinations took, is highest. The bound narrows as combinations are
+ * tried in the region and widens slowly with the number tried in all of
+ * them, so that a region that looked poor early is eventually tried again.
+ * Returns false once every combination has been given out. */
+bool AnytimeSearch::pick(void)
+{
+	double logTried = std::log(std::max(this->tried, 2L));
+	double best = -1;
+	int choice = -1;
+
+	for (int index = 0; index < static_cast<int>(this->regions.size());
+		 ++index) {
+
+		Region& region = this->regions[index];
+		double hits = region.hits + 1;
+		double score = 0;
+
+		if (region.given == region.size) continue;
+
+		if (region.given == 0) {
+			choice = index;
+			break;
+		}
+
+		/* Until its first results are in, a region is only picked if no
+		 * other is left. */
+		if (region.tried > 0) {
+			score = (hits + std::sqrt(2 * hits * logTried))
+				  / (region.nanoseconds + 1);
+		}
+
+		if (score > best) {
+			best = score;
+			choice = index;
+		}
+	}
+
+	if (choice < 0) return false;
+
+	Region& region = this->regions[choice];
+
+	this->current = choice;
+	this->chunk = std::min(region.size - region.given,
+						   std::clamp(region.tried, AnytimeProbe,
+									  AnytimeChunk));
+	return true;
+}
+
+/* Gives out the next combinations of the region picked, up to the end of
+ * what was picked, saving the progress first if it is time to. Nothing is
+ * given out after the deadline. */
+int AnytimeSearch::populate(std::deque<Parameters>& queue, int count)
+{
+	std::scoped_lock<std::mutex> lock(this->regionsLock);
+	long now = steadyNanoseconds();
+	long length;
+
+	if (this->deadline > 0 && now >= this->deadline) return 0;
+
+	if (this->progressPath != nullptr && now >= this->checkpoint) {
+		this->write();
+		this->checkpoint = now + CheckpointNanoseconds;
+	}
+
+	/* Excluded combinations count as given out, but are not tried, so
+	 * this goes on until some are left or nothing is. */
+	for (;;) {
+		std::deque<Parameters> picked;
+		int kept = 0;
+
+		if (this->chunk == 0 && !this->pick()) return 0;
+
+		Region& region = this->regions[this->current];
+
+		length = std::min(static_cast<long>(count), this->chunk);
+		this->generator.seek(region.start + region.given);
+		this->generator.populate(picked, length);
+		region.given += length;
+		this->chunk -= length;
+
+		for (Parameters& parameters : picked) {
+			if (this->excluded == nullptr
+				|| !this->excluded->gives(parameters)) {
+
+				queue.push_back(parameters);
+				++kept;
+			}
+		}
+
+		region.outstanding += kept;
+
+		if (region.outstanding == 0) region.settle();
+
+		if (kept > 0) return kept;
+	}
+}
+
+/* The shape of the region that will be given out from next, or -1 once
+ * nothing more will be. */
+int AnytimeSearch::nextShape(void)
+{
+	std::scoped_lock<std::mutex> lock(this->regionsLock);
+
+	if (this->deadline > 0 && steadyNanoseconds() >= this->deadline) {
+		return -1;
+	}
+
+	if (this->chunk == 0 && !this->pick()) return -1;
+
+	return this->regions[this->current].shape;
+}
+
+/* Adds the outcome to the results of its region, and reports identities
+ * right away, as the generator does. */
+void AnytimeSearch::finish(WorkerThread& worker, Parameters& parameters,
+						   ProductSignature& signature, bool identity,
+						   long nanoseconds)
+{
+	if (identity) {
+		worker.reportIdentity(parameters, signature, std::cout);
+	}
+
+	std::scoped_lock<std::mutex> lock(this->regionsLock);
+	long position = this->generator.position(parameters);
+
+	/* The region is the last one starting at or before the position. */
+	auto region = std::upper_bound(this->regions.begin(),
+								   this->regions.end(), position,
+								   [](long position, const Region& region) {
+									   return position < region.start;
+								   }) - 1;
+
+	region->tried++;
+	region->hits += identity;
+	region->nanoseconds += nanoseconds;
+	this->tried++;
+
+	if (--region->outstanding == 0) region->settle();
+}
+
+/* Loads the progress saved by an earlier run from the file at the given
+ * path, and saves the progress there from then on. A missing file is the
+ * start of a new search. Returns false if the file does not describe the
+ * regions of this search, which happens when it was written for other
+ * search bounds. */
+bool AnytimeSearch::load(const char *path)
+{
+	std::ifstream file(path);
+	std::string line;
+
+	this->progressPath = path;
+
+	if (!file) return true;
+
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		long start;
+		long size;
+		long given;
+		long tried;
+		long hits;
+		long nanoseconds;
+
+		if (line.empty() || line[0] == '#') continue;
+
+		if (!(fields >> start >> size >> given >> tried >> hits
+			  >> nanoseconds)) {
+
+			start = -1;
+		}
+
+		auto region = std::lower_bound(this->regions.begin(),
+									   this->regions.end(), start,
+									   [](const Region& region, long start) {
+										   return region.start < start;
+									   });
+
+		if (region == this->regions.end() || region->start != start
+			|| region->size != size || given < 0 || given > size
+			|| tried < 0 || hits < 0 || nanoseconds < 0) {
+
+			std::cerr << "The progress file " << path << " does not match "
+						 "the regions of this search.\n";
+			return false;
+		}
+
+		region->given = given;
+		region->tried = tried;
+		region->hits = hits;
+		region->nanoseconds = nanoseconds;
+		region->settle();
+		this->tried += tried;
+	}
+
+	return true;
+}
+
+/* Writes the progress to a file beside the progress file, and then moves
+ * it in place of it, so that a run stopped while writing leaves the last
+ * progress saved intact. For each region a line holds its start and size,
+ * the combinations given out of it that have settled, and their results.
+ * A search resumed from a save in the middle of a run tries the rest of
+ * the combinations again, counting each of them once, though identities
+ * among them are reported again. Returns false if the progress could not
+ * be saved. */
+bool AnytimeSearch::write(void)
+{
+	std::string temporary = std::string(this->progressPath) + ".tmp";
+	std::ofstream file(temporary);
+
+	file << "# start size given tried hits nanoseconds\n";
+
+	for (Region& region : this->regions) {
+		if (region.settled == 0) continue;
+
+		file << region.start << ' ' << region.size << ' ' << region.settled
+			 << ' ' << region.settledTried << ' ' << region.settledHits
+			 << ' ' << region.settledNanoseconds << '\n';
+	}
+
+	file.close();
+
+	if (!file || std::rename(temporary.c_str(), this->progressPath) != 0) {
+		std::cerr << "Cannot save the progress to " << this->progressPath
+				  << ".\n";
+		return false;
+	}
+
+	return true;
+}
+
+/* Saves the progress, if there is a progress file, once the search has
+ * ended and every combination given out has been tried. Returns false if
+ * it could not be saved. */
+bool AnytimeSearch::save(void)
+{
+	std::scoped_lock<std::mutex> lock(this->regionsLock);
+
+	return this->progressPath == nullptr || this->write();
+}
+
+/* Starts the clock, so that nothing is given out once the given number of
+ * seconds has passed, or ever stops being given out if it is 0. */
+void AnytimeSearch::start(long seconds)
+{
+	long now = steadyNanoseconds();
+
+	this->deadline = seconds > 0 ? now + seconds * 1000000000 : 0;
+	this->checkpoint = now + CheckpointNanoseconds;
+}
+
+/* Searches the combinations within the given bounds, skipping those the
+ * excluded generator gives out, or none if it is nullptr, by splitting
+ * every shape of them into regions. This must come before load. */
+void AnytimeSearch::bound(const SearchBounds& bounds,
+						  ParameterGenerator *excluded)
+{
+	long start = 0;
+
+	this->generator = ParameterGenerator(bounds);
+	this->excluded = excluded;
+	this->regions.clear();
+
+	for (int shape = 0; shape < ShapeCount; ++shape) {
+		long size = this->generator.shapeSize(shape);
+		long regionSize = this->generator.regionSize(shape);
+
+		for (long offset = 0; offset < size; offset += regionSize) {
+			this->regions.push_back({start + offset, regionSize, shape, 0, 0,
+									 0, 0, 0, 0, 0, 0, 0});
+		}
+
+		start += size;
+	}
+}
+
+/* Searches the default search bounds. */
+AnytimeSearch::AnytimeSearch(void)
+{
+	this->current = -1;
+	this->chunk = 0;
+	this->tried = 0;
+	this->deadline = 0;
+	this->checkpoint = 0;
+	this->progressPath = nullptr;
+	this->bound(SearchBounds(), nullptr);
+}
+
+};
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* The largest fraction by which a slice may be slower than its baseline
+ * before the comparison fails. */
+const static double BenchmarkTolerance = 0.1;
+
+/* The bounds the slices are taken within, which are those the search was
+ * built for when they were chosen. Every bound is given, so that changing
+ * the defaults does not move the slices. */
+const static char BenchmarkBounds[] =
+	"Max_qScalarsDegree1=2,Max_qScalarsDegree2Pure=2,"
+	"Max_qScalarsDegree2Mixed=2,Max_qPS_power=2,Max_qPS_dilation1=2,"
+	"Max_qPS_dilation2=2,Max_qPS_subScalars=2,Max_qBinomial_dilation=2,"
+	"Min_indicesInUse=2,Max_indicesInUse=2,Max_qPSInUse=2";
+
+/* A named run of combinations in the order of the parameter generator. It
+ * starts in the shape given by whether it has a $q$-binomial factor and its
+ * numbers of indices and $q$-Pochhammer symbols, at the offset within that
+ * shape, or counted back from its end if the offset is negative. */
+struct BenchmarkSlice
+{
+	const char *name;
+	bool qBinomial;
+	int indices;
+	int qPS;
+	long offset;
+	long count;
+};
+
+/* The slices to measure. The cheap slice starts from the beginning, with
+ * at most one $q$-Pochhammer symbol, the Pochhammer-heavy slice has two
+ * with the largest powers, dilations and subscripts, which come last in
+ * their shape, and the hit-dense slice is where the most identities were
+ * found per candidate. */
+const static BenchmarkSlice BenchmarkSlices[] = {
+	{"cheap", false, 2, 0, 0, 20000},
+	{"pochhammer", false, 2, 2, -30976, 20000},
+	{"hits", false, 2, 2, 216832, 20000},
+};
+
+/* Gives out the next combinations of the slice. */
+int Benchmark::populate(std::deque<Parameters>& queue, int count)
+{
+	int length = this->generator.populate(queue,
+				 std::min(static_cast<long>(count), this->remaining));
+
+	this->remaining -= length;
+	return length;
+}
+
+/* The shape of the next combination of the slice, or -1 after its end. */
+int Benchmark::nextShape(void)
+{
+	return this->remaining > 0 ? this->generator.nextShape() : -1;
+}
+
+/* Adds the outcome to the results. Identities are formatted as they would
+ * be for output, but then thrown away. */
+void Benchmark::finish(WorkerThread& worker, Parameters& parameters,
+					   ProductSignature& signature, bool identity, long)
+{
+	long nanoseconds = 0;
+
+	if (identity) {
+		auto start = std::chrono::steady_clock::now();
+		std::ostringstream discard;
+
+		worker.reportIdentity(parameters, signature, discard);
+		nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					  std::chrono::steady_clock::now() - start).count();
+	}
+
+	std::scoped_lock<std::mutex> lock(this->resultsLock);
+
+	this->candidates++;
+	this->hits += identity;
+	this->seriesNanoseconds += worker.seriesNanoseconds;
+	this->factorizeNanoseconds += worker.factorizeNanoseconds;
+	this->outputNanoseconds += nanoseconds;
+}
+
+/* Runs the slice with the given name, or every slice if it is "all", and
+ * writes the results to stdout. Given the path to a baseline, which holds
+ * lines written by an earlier run, each slice found there must find the
+ * same number of identities without getting slower by more than
+ * BenchmarkTolerance. Returns 0 if every slice passed, and 1 otherwise. */
+int Benchmark::run(const char *name, const char *baseline, Catalog *catalog,
+				   SeriesStore *store, ProductIndex *index)
+{
+	std::unordered_map<std::string, std::pair<long, double>> expected;
+	bool found = false;
+	bool passed = true;
+
+	if (baseline != nullptr) {
+		std::ifstream file(baseline);
+		std::string line;
+
+		if (!file) {
+			std::cerr << "Cannot open the baseline " << baseline << ".\n";
+			return 1;
+		}
+
+		while (std::getline(file, line)) {
+			std::istringstream fields(line);
+			std::string slice;
+			long candidates;
+			long hits;
+			double seconds;
+			double rate;
+
+			if (line.empty() || line[0] == '#') continue;
+
+			if (fields >> slice >> candidates >> hits >> seconds >> rate) {
+				expected[slice] = {hits, rate};
+			}
+		}
+	}
+
+	std::cout << "# slice candidates hits seconds candidates/s "
+				 "series factorize output\n" << std::fixed;
+
+	for (const BenchmarkSlice& slice : BenchmarkSlices) {
+		if (std::strcmp(name, "all") != 0
+			&& std::strcmp(name, slice.name) != 0) {
+
+			continue;
+		}
+
+		Scheduler scheduler(this);
+		SearchBounds bounds;
+		int shape = Parameters::shapeOf(slice.qBinomial, slice.indices,
+										slice.qPS);
+		long first;
+
+		if (!bounds.read(BenchmarkBounds)) return 1;
+
+		found = true;
+		this->generator = ParameterGenerator(bounds);
+		first = slice.offset;
+
+		if (first < 0) first += this->generator.shapeSize(shape);
+
+		this->generator.seek(this->generator.shapeStart(shape) + first);
+		this->remaining = slice.count;
+		this->candidates = 0;
+		this->hits = 0;
+		this->seriesNanoseconds = 0;
+		this->factorizeNanoseconds = 0;
+		this->outputNanoseconds = 0;
+
+		auto start = std::chrono::steady_clock::now();
+
+		scheduler.run(catalog, store, index, BenchmarkThreadsToUse);
+
+		double seconds = std::chrono::duration<double>(
+						 std::chrono::steady_clock::now() - start).count();
+		double rate = this->candidates / seconds;
+
+		std::cout << slice.name << ' ' << this->candidates << ' '
+				  << this->hits << std::setprecision(3) << ' ' << seconds
+				  << ' ' << std::setprecision(1) << rate
+				  << std::setprecision(3)
+				  << ' ' << this->seriesNanoseconds / 1e9
+				  << ' ' << this->factorizeNanoseconds / 1e9
+				  << ' ' << this->outputNanoseconds / 1e9 << '\n';
+
+		auto entry = expected.find(slice.name);
+
+		if (entry == expected.end()) continue;
+
+		/* A different number of identities means the search changed, which
+		 * makes the speed meaningless to compare. */
+		if (this->hits != entry->second.first) {
+			std::cout << "# " << slice.name << " FAILED: expected "
+					  << entry->second.first << " hits\n";
+			passed = false;
+		} else if (rate < entry->second.second * (1 - BenchmarkTolerance)) {
+			std::cout << "# " << slice.name << " FAILED: "
+					  << std::setprecision(1) << 100 * (1 - rate
+						 / entry->second.second) << "% slower\n";
+			passed = false;
+		} else {
+			std::cout << "# " << slice.name << " passed\n";
+		}
+	}
+
+	if (!found) {
+		std::cerr << "There is no benchmark slice named " << name << ".\n";
+		return 1;
+	}
+
+	return passed ? 0 : 1;
+}
+
+};
@@ -0,0 +1,110 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Reads the catalog from the file at the given path. Each line is either
+ * blank, a comment starting with #, a product signature written as
+ * "product" followed by a period $\ell$ and the powers $a_1, \dots, a_\ell$
+ * of $\prod_{n \geq 1} \frac{1}{(1-q^n)^{a_n}}$, or a $q$-series written as
+ * "series" followed by at least FingerprintLength of its coefficients.
+ * Returns false and prints the reason if the file cannot be used. */
+bool Catalog::load(const char *path)
+{
+	std::ifstream file(path);
+	std::string line;
+	int lineNumber = 0;
+
+	if (!file) {
+		std::cerr << "Cannot open the catalog " << path << ".\n";
+		return false;
+	}
+
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string kind;
+		std::vector<long> values;
+		long value;
+
+		++lineNumber;
+
+		if (!(fields >> kind) || kind[0] == '#') continue;
+
+		if (kind == "product") {
+			ProductSignature signature;
+
+			if (!signature.read(fields, path, lineNumber)) return false;
+
+			values.assign(signature.powers,
+						  signature.powers + signature.period);
+			values.insert(values.begin(), signature.period);
+			this->products.insert(values);
+			continue;
+		}
+
+		while (fields >> value) {
+			values.push_back(value);
+		}
+
+		if (!fields.eof()) {
+			std::cerr << path << ":" << lineNumber << ": expected only "
+						 "integers after " << kind << ".\n";
+			return false;
+		}
+
+		if (kind == "series") {
+			if (static_cast<int>(values.size()) < FingerprintLength) {
+				std::cerr << path << ":" << lineNumber << ": a series needs "
+							 "at least " << FingerprintLength
+						  << " coefficients.\n";
+				return false;
+			}
+
+			values.resize(FingerprintLength);
+			this->fingerprints.insert(values);
+		} else {
+			std::cerr << path << ":" << lineNumber << ": unknown entry "
+					  << kind << ".\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Checks whether the product signature or the leading coefficients of the
+ * $q$-series it was found from are in the catalog. The series is nullptr
+ * for sums whose product is known without computing it, and then the
+ * leading coefficients are those of the product. */
+bool Catalog::contains(ProductSignature& signature, QSeries *series)
+{
+	if (!this->products.empty()) {
+		std::vector<long> key(signature.powers,
+							  signature.powers + signature.period);
+
+		key.insert(key.begin(), signature.period);
+
+		if (this->products.count(key) != 0) return true;
+	}
+
+	if (!this->fingerprints.empty()) {
+		QSeries expansion(FingerprintLength);
+
+		if (series == nullptr) {
+			signature.expand(expansion);
+			series = &expansion;
+		}
+
+		std::vector<long> key(series->coefficients,
+							  series->coefficients + FingerprintLength);
+
+		if (this->fingerprints.count(key) != 0) return true;
+	}
+
+	return false;
+}
+
+};
@@ -0,0 +1,202 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Starts listening on a Unix socket at the given path, replacing any file
+ * there, instead of reading standard input. Writing to a client that went
+ * away would raise SIGPIPE and end the daemon, so the signal is ignored and
+ * the write fails instead. Returns false and prints the reason if the
+ * socket cannot be set up. */
+bool Daemon::listen(const char *path)
+{
+	struct sockaddr_un address = {};
+
+	if (std::strlen(path) >= sizeof(address.sun_path)) {
+		std::cerr << "The socket path " << path << " is too long.\n";
+		return false;
+	}
+
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, path);
+	unlink(path);
+	std::signal(SIGPIPE, SIG_IGN);
+
+	this->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (this->listener < 0
+		|| bind(this->listener, reinterpret_cast<struct sockaddr *>(&address),
+				sizeof(address)) != 0
+		|| ::listen(this->listener, 16) != 0) {
+
+		std::cerr << "Cannot listen on the socket " << path << ".\n";
+		return false;
+	}
+
+	this->input = -1;
+	this->output = -1;
+	return true;
+}
+
+/* Takes the next line of input out of the buffer, reading more only if
+ * wait is set. Returns false if there is no complete line, which when
+ * waiting means the input has ended. A final line without a newline still
+ * counts, and a read interrupted by a signal is simply tried again. */
+bool Daemon::readLine(std::string& line, bool wait)
+{
+	for (;;) {
+		std::size_t end = this->buffer.find('\n');
+		char chunk[65536];
+		long length;
+
+		if (end != std::string::npos) {
+			line = this->buffer.substr(0, end);
+			this->buffer.erase(0, end + 1);
+			return true;
+		}
+
+		if (!wait) return false;
+
+		length = read(this->input, chunk, sizeof(chunk));
+
+		if (length < 0 && errno == EINTR) continue;
+
+		if (length <= 0) {
+			if (this->buffer.empty()) return false;
+
+			line.swap(this->buffer);
+			this->buffer.clear();
+			return true;
+		}
+
+		this->buffer.append(chunk, length);
+	}
+}
+
+/* Writes one line of answer in a single call, so answers from different
+ * worker threads never interleave. */
+void Daemon::answer(const std::string& text)
+{
+	std::scoped_lock<std::mutex> lock(this->outputLock);
+	const char *data = text.data();
+	long remaining = text.size();
+
+	while (remaining > 0) {
+		long length = write(this->output, data, remaining);
+
+		if (length < 0 && errno == EINTR) continue;
+
+		/* A client that went away, which shows as EPIPE or ECONNRESET,
+		 * simply loses its answers. */
+		if (length <= 0) return;
+
+		data += length;
+		remaining -= length;
+	}
+}
+
+/* Parses requests into the queue, waiting for the first one but taking the
+ * rest only if they have already arrived. Malformed requests are answered
+ * right away. When a socket client closes its end, this waits for its
+ * outstanding answers, then for the next client. */
+int Daemon::populate(std::deque<Parameters>& queue, int count)
+{
+	std::string line;
+	int length = 0;
+
+	while (length < count) {
+		Parameters parameters;
+		std::istringstream fields;
+		std::string rest;
+
+		if (!this->readLine(line, length == 0)) {
+			if (length > 0) break;
+
+			if (this->listener < 0) return 0;
+
+			/* Only once every answer for this client has been written may
+			 * its connection be closed. */
+			{
+				std::unique_lock<std::mutex> lock(this->outputLock);
+
+				this->allAnswered.wait(lock, [this] {
+					return this->outstanding == 0;
+				});
+			}
+
+			if (this->input >= 0) {
+				close(this->input);
+			}
+
+			this->buffer.clear();
+			this->input = accept(this->listener, nullptr, nullptr);
+			this->output = this->input;
+
+			if (this->input < 0) return 0;
+
+			continue;
+		}
+
+		if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+		fields.str(line);
+
+		if (!parameters.read(fields) || (fields >> rest)) {
+			this->answer(line + " : error\n");
+			continue;
+		}
+
+		queue.push_back(parameters);
+		++length;
+	}
+
+	std::scoped_lock<std::mutex> lock(this->outputLock);
+
+	this->outstanding += length;
+	return length;
+}
+
+/* Requests may come in any shape. */
+int Daemon::nextShape(void)
+{
+	return -1;
+}
+
+/* Every request is answered, whether or not it gave an identity. */
+void Daemon::finish(WorkerThread&, Parameters& parameters,
+					ProductSignature& signature, bool, long)
+{
+	std::ostringstream text;
+
+	parameters.write(text);
+	text << " : ";
+	signature.write(text);
+	text << '\n';
+	this->answer(text.str());
+
+	std::scoped_lock<std::mutex> lock(this->outputLock);
+
+	if (--this->outstanding == 0) {
+		this->allAnswered.notify_all();
+	}
+}
+
+Daemon::~Daemon(void)
+{
+	if (this->listener >= 0) {
+		close(this->listener);
+
+		if (this->input >= 0) {
+			close(this->input);
+		}
+	}
+}
+
+};
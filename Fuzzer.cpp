@@ -0,0 +1,569 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Kinds of cases: a specialized kernel against qSeries, factorizeBatch
+ * against factorize, and applyQPochhammer and applyQBinomial against the
+ * factor they multiply by. */
+const static int FuzzKernel = 0;
+const static int FuzzFactorize = 1;
+const static int FuzzQPochhammer = 2;
+const static int FuzzQBinomial = 3;
+const static int FuzzKinds = 4;
+
+/* Number of cases between progress reports when soaking. */
+const static long FuzzProgressInterval = 100;
+
+/* A uniform random integer from minimum to maximum inclusive. */
+int Fuzzer::uniform(int minimum, int maximum)
+{
+	return std::uniform_int_distribution<int>(minimum, maximum)(this->random);
+}
+
+/* Random parameters with up to the given number of indices, kept to small
+ * values so that the series stay cheap to evaluate. Every index raises the
+ * power of $q$, since the reference would otherwise sum forever, and with
+ * the most indices every index does so quadratically, since otherwise a
+ * single case takes minutes. */
+Parameters Fuzzer::randomParameters(int maxIndices)
+{
+	Parameters parameters = {};
+
+	parameters.indicesInUse = this->uniform(1, maxIndices);
+	parameters.qPSInUse = this->uniform(0, MaxQPS);
+	parameters.alternatingSign = this->uniform(0, 1);
+	parameters.dividePowerBy2 = this->uniform(0, 1);
+
+	if (parameters.indicesInUse > 1 && this->uniform(0, 2) == 0) {
+		parameters.qBinomialDilation = this->uniform(1, 3);
+	}
+
+	for (int index = 0; index < parameters.indicesInUse; ++index) {
+		parameters.qScalarsDegree1[index] = this->uniform(0, 3);
+		parameters.qScalarsDegree2Pure[index] = this->uniform(
+			parameters.indicesInUse == MaxIndices, 2);
+
+		if (parameters.qScalarsDegree1[index] == 0
+			&& parameters.qScalarsDegree2Pure[index] == 0) {
+			parameters.qScalarsDegree1[index] = 1;
+		}
+	}
+
+	for (int index = 0; index < parameters.indicesInUse
+		 * (parameters.indicesInUse - 1) / 2; ++index) {
+		parameters.qScalarsDegree2Mixed[index] = this->uniform(0, 2);
+	}
+
+	for (int nIndex = 0; nIndex < parameters.qPSInUse; ++nIndex) {
+		auto& symbol = parameters.qPS[nIndex];
+		bool nonzero = false;
+
+		symbol.dilation1 = this->uniform(0, 3);
+		symbol.dilation2 = this->uniform(1, 3);
+		symbol.negativePrefix = this->uniform(0, 1);
+		symbol.power = this->uniform(1, 3);
+
+		if (symbol.dilation1 > 0 && this->uniform(0, 1) == 0) {
+			symbol.power = -symbol.power;
+		}
+
+		for (int kIndex = 0; kIndex < parameters.indicesInUse; ++kIndex) {
+			symbol.subScalars[kIndex] = this->uniform(0, 2);
+			nonzero = nonzero || symbol.subScalars[kIndex] != 0;
+		}
+
+		if (!nonzero) {
+			symbol.subScalars[this->uniform(0,
+							  parameters.indicesInUse - 1)] = 1;
+		}
+	}
+
+	return parameters;
+}
+
+/* A random series with constant term 1, so that it has a reciprocal: a
+ * product with a periodic pattern of powers, a series of the search with
+ * up to two indices, or small random coefficients. */
+QSeries Fuzzer::randomSeries(int limit)
+{
+	QSeries series(limit);
+	int choice = this->uniform(0, 2);
+
+	if (choice == 0) {
+		int period = this->uniform(1, 6);
+		int powers[6];
+
+		for (int index = 0; index < period; ++index) {
+			powers[index] = this->uniform(-3, 3);
+		}
+
+		series.zero();
+		series.coefficients[0] = 1;
+
+		for (int n = 1; n < limit; ++n) {
+			series.applyFactor(n, false, -powers[(n - 1) % period]);
+		}
+	} else if (choice == 1) {
+		Parameters parameters = this->randomParameters(2);
+
+		(series.*QSeries::kernel(parameters, limit))(parameters, 0, 1);
+	} else {
+		series.coefficients[0] = 1;
+
+		for (int index = 1; index < limit; ++index) {
+			series.coefficients[index] = this->uniform(-3, 3);
+		}
+	}
+
+	return series;
+}
+
+/* A random case of a random kind. Kernels are mostly checked up to
+ * MaxSeriesLimit, and with at most two indices sometimes up to
+ * MaxVerificationLimit as well. Cases with the most indices take up to a
+ * second each, so they are only tried when soaking. */
+Fuzzer::Case Fuzzer::randomCase(bool soak)
+{
+	Case testCase;
+
+	testCase.kind = this->uniform(0, FuzzKinds - 1);
+	testCase.parameters = {};
+
+	for (int index = 0; index < 5; ++index) {
+		testCase.arguments[index] = 0;
+	}
+
+	if (testCase.kind == FuzzKernel) {
+		testCase.parameters = this->randomParameters(soak ? MaxIndices
+													 : MaxIndices - 1);
+		testCase.arguments[0] = MaxSeriesLimit;
+		testCase.arguments[1] = this->uniform(2, 5);
+
+		if (testCase.parameters.indicesInUse <= 2
+			&& this->uniform(0, 7) == 0) {
+			testCase.arguments[0] = MaxVerificationLimit;
+		}
+	} else if (testCase.kind == FuzzFactorize) {
+		int count = this->uniform(1, BatchLanes);
+
+		for (int lane = 0; lane < count; ++lane) {
+			testCase.series.push_back(this->randomSeries(MaxSeriesLimit));
+		}
+	} else if (testCase.kind == FuzzQPochhammer) {
+		testCase.arguments[0] = this->uniform(0, 3);
+		testCase.arguments[1] = this->uniform(0, 3);
+		testCase.arguments[2] = this->uniform(0, 1);
+		testCase.arguments[3] = this->uniform(0, 40);
+		testCase.arguments[4] = this->uniform(1, 3);
+
+		/* Powers past those expanded with binomial coefficients. */
+		if (this->uniform(0, 3) == 0) {
+			testCase.arguments[4] = this->uniform(55, 120);
+		}
+
+		if (testCase.arguments[0] > 0 && this->uniform(0, 1) == 0) {
+			testCase.arguments[4] = -testCase.arguments[4];
+		}
+
+		testCase.series.push_back(this->randomSeries(MaxSeriesLimit));
+	} else {
+		testCase.arguments[0] = this->uniform(0, 40);
+		testCase.arguments[1] = this->uniform(0, testCase.arguments[0] + 2);
+		testCase.arguments[2] = this->uniform(1, 3);
+		testCase.series.push_back(this->randomSeries(MaxSeriesLimit));
+	}
+
+	return testCase;
+}
+
+/* Describes the first difference between the result of the fast path and
+ * the plain code in the case, or gives the empty string if they agree.
+ * Cases the plain code does not accept, as shrinking can make them, agree
+ * trivially. */
+std::string Fuzzer::check(Case& testCase)
+{
+	std::stringstream text;
+
+	auto difference = [&text](const char *what, QSeries& fast,
+							  QSeries& plain) {
+		for (int index = 0; index < plain.limit; ++index) {
+			if (fast.coefficients[index] != plain.coefficients[index]) {
+				text << what << " gives " << fast.coefficients[index]
+					 << " instead of " << plain.coefficients[index]
+					 << " at q^" << index;
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	if (testCase.kind == FuzzKernel) {
+		Parameters& parameters = testCase.parameters;
+		Parameters copy;
+		std::stringstream line;
+		int limit = testCase.arguments[0];
+		int parts = testCase.arguments[1];
+
+		parameters.write(line);
+
+		if (parts < 2 || !copy.read(line)) {
+			return "";
+		}
+
+		for (int index = 0; index < parameters.indicesInUse; ++index) {
+			if (parameters.qScalarsDegree1[index] == 0
+				&& parameters.qScalarsDegree2Pure[index] == 0) {
+				return "";
+			}
+		}
+
+		QSeries::Kernel kernel = QSeries::kernel(parameters, limit);
+		QSeries plain(limit);
+		QSeries fast(limit);
+		QSeries sum(limit);
+
+		plain.qSeries(parameters);
+		(fast.*kernel)(parameters, 0, 1);
+
+		if (difference("the kernel", fast, plain)) {
+			return text.str();
+		}
+
+		sum.zero();
+
+		for (int part = 0; part < parts; ++part) {
+			(fast.*kernel)(parameters, part, parts);
+			sum += fast;
+		}
+
+		if (difference("the sum of the parts of the kernel", sum, plain)) {
+			return text.str();
+		}
+
+		/* With the same symbols and a power of $q$ growing more slowly,
+		 * the kernel reads back the products kept for the case, including
+		 * ones kept too short for it. */
+		if (limit == MaxSeriesLimit && parameters.indicesInUse <= 2) {
+			Parameters slower = parameters;
+
+			for (int index = 0; index < slower.indicesInUse; ++index) {
+				if (slower.qScalarsDegree1[index] > 0) {
+					slower.qScalarsDegree2Pure[index] = 0;
+				}
+			}
+
+			slower.qScalarsDegree2Mixed[0] = 0;
+			plain.qSeries(slower);
+			(fast.*kernel)(slower, 0, 1);
+
+			if (difference("the kernel reading back products", fast,
+						   plain)) {
+				return text.str();
+			}
+		}
+	} else if (testCase.kind == FuzzFactorize) {
+		int count = testCase.series.size();
+		QSeries *series[BatchLanes];
+		ProductSignature batched[BatchLanes];
+		ProductSignature *signatures[BatchLanes];
+
+		for (int lane = 0; lane < count; ++lane) {
+			series[lane] = &testCase.series[lane];
+			signatures[lane] = &batched[lane];
+		}
+
+		ProductSignature::factorizeBatch(series, signatures, count);
+
+		for (int lane = 0; lane < count; ++lane) {
+			ProductSignature single;
+			bool same;
+
+			single.factorize(testCase.series[lane]);
+			same = single.period == batched[lane].period;
+
+			for (int index = 0; same && index < single.period; ++index) {
+				same = single.powers[index] == batched[lane].powers[index];
+			}
+
+			if (!same || (single.period > 0
+						  && single.limit != batched[lane].limit)) {
+				text << "factorizeBatch gives ";
+				batched[lane].write(text);
+				text << " instead of ";
+				single.write(text);
+				text << " in lane " << lane;
+				return text.str();
+			}
+		}
+	} else if (testCase.kind == FuzzQPochhammer) {
+		int dilation1 = testCase.arguments[0];
+		int dilation2 = testCase.arguments[1];
+		bool negativePrefix = testCase.arguments[2];
+		int subscript = testCase.arguments[3];
+		int power = testCase.arguments[4];
+		QSeries fast = testCase.series[0];
+		QSeries factor;
+
+		if (dilation1 < 0 || dilation2 < 0 || testCase.arguments[2] < 0
+			|| testCase.arguments[2] > 1 || subscript < 0 || power == 0
+			|| (power < 0 && dilation1 == 0)) {
+			return "";
+		}
+
+		fast.applyQPochhammer(dilation1, dilation2, negativePrefix,
+							  subscript, power);
+		factor.qPochhammer(dilation1, dilation2, negativePrefix, subscript);
+		factor.raiseToPower(power);
+
+		QSeries plain = testCase.series[0] * factor;
+
+		if (difference("applyQPochhammer", fast, plain)) {
+			return text.str();
+		}
+	} else {
+		int top = testCase.arguments[0];
+		int bottom = testCase.arguments[1];
+		int dilation = testCase.arguments[2];
+		QSeries fast = testCase.series[0];
+		QSeries plain;
+
+		if (top < 0 || bottom < 0 || dilation < 1) {
+			return "";
+		}
+
+		fast.applyQBinomial(top, bottom, dilation);
+		plain.zero();
+
+		if (bottom <= top) {
+			QSeries numerator;
+			QSeries bottomFactor;
+			QSeries restFactor;
+
+			numerator.qPochhammer(dilation, dilation, false, top);
+			bottomFactor.qPochhammer(dilation, dilation, false, bottom);
+			bottomFactor.reciprocal();
+			restFactor.qPochhammer(dilation, dilation, false, top - bottom);
+			restFactor.reciprocal();
+			plain = testCase.series[0] * numerator * bottomFactor
+				  * restFactor;
+		}
+
+		if (difference("applyQBinomial", fast, plain)) {
+			return text.str();
+		}
+	}
+
+	return "";
+}
+
+/* Takes the first step that leaves a smaller case still disagreeing, for
+ * as long as there is one: dropping a $q$-Pochhammer symbol, the
+ * $q$-binomial factor or a series, clearing a flag, or moving a parameter,
+ * argument or coefficient towards zero. */
+void Fuzzer::shrink(Case& testCase)
+{
+	auto fields = [](Parameters& parameters) {
+		std::vector<int *> fields;
+
+		for (int index = 0; index < parameters.indicesInUse; ++index) {
+			fields.push_back(&parameters.qScalarsDegree1[index]);
+			fields.push_back(&parameters.qScalarsDegree2Pure[index]);
+		}
+
+		for (int index = 0; index < parameters.indicesInUse
+			 * (parameters.indicesInUse - 1) / 2; ++index) {
+			fields.push_back(&parameters.qScalarsDegree2Mixed[index]);
+		}
+
+		for (int nIndex = 0; nIndex < parameters.qPSInUse; ++nIndex) {
+			fields.push_back(&parameters.qPS[nIndex].dilation1);
+			fields.push_back(&parameters.qPS[nIndex].dilation2);
+			fields.push_back(&parameters.qPS[nIndex].power);
+
+			for (int kIndex = 0; kIndex < parameters.indicesInUse;
+				 ++kIndex) {
+				fields.push_back(&parameters.qPS[nIndex].subScalars[kIndex]);
+			}
+		}
+
+		if (parameters.qBinomialDilation > 0) {
+			fields.push_back(&parameters.qBinomialDilation);
+		}
+
+		return fields;
+	};
+
+	auto towardsZero = [](int& value) {
+		value -= value > 0 ? 1 : -1;
+	};
+
+	for (bool shrunk = true; shrunk;) {
+		std::vector<Case> candidates;
+
+		shrunk = false;
+
+		if (testCase.kind == FuzzKernel) {
+			Parameters& parameters = testCase.parameters;
+			int fieldCount = fields(parameters).size();
+
+			if (parameters.qPSInUse > 0) {
+				candidates.push_back(testCase);
+				--candidates.back().parameters.qPSInUse;
+			}
+
+			if (parameters.qBinomialDilation > 0) {
+				candidates.push_back(testCase);
+				candidates.back().parameters.qBinomialDilation = 0;
+			}
+
+			if (parameters.alternatingSign) {
+				candidates.push_back(testCase);
+				candidates.back().parameters.alternatingSign = false;
+			}
+
+			if (parameters.dividePowerBy2) {
+				candidates.push_back(testCase);
+				candidates.back().parameters.dividePowerBy2 = false;
+			}
+
+			for (int nIndex = 0; nIndex < parameters.qPSInUse; ++nIndex) {
+				if (parameters.qPS[nIndex].negativePrefix) {
+					candidates.push_back(testCase);
+					candidates.back().parameters.qPS[nIndex].negativePrefix
+						= false;
+				}
+			}
+
+			for (int index = 0; index < fieldCount; ++index) {
+				if (*fields(parameters)[index] != 0) {
+					candidates.push_back(testCase);
+					towardsZero(*fields(candidates.back().parameters)[index]);
+				}
+			}
+
+			if (testCase.arguments[1] > 2) {
+				candidates.push_back(testCase);
+				--candidates.back().arguments[1];
+			}
+		} else {
+			for (int lane = 0; testCase.series.size() > 1
+				 && lane < static_cast<int>(testCase.series.size());
+				 ++lane) {
+
+				candidates.push_back(testCase);
+				candidates.back().series.erase(
+					candidates.back().series.begin() + lane);
+			}
+
+			for (int index = 0; index < 5; ++index) {
+				if (testCase.arguments[index] != 0) {
+					candidates.push_back(testCase);
+					towardsZero(candidates.back().arguments[index]);
+				}
+			}
+
+			for (int lane = 0; lane < static_cast<int>(testCase.series.size());
+				 ++lane) {
+
+				QSeries& series = testCase.series[lane];
+
+				for (int index = 1; index < series.limit; ++index) {
+					if (series.coefficients[index] != 0) {
+						candidates.push_back(testCase);
+						candidates.back().series[lane].coefficients[index]
+							/= 2;
+					}
+				}
+			}
+		}
+
+		for (Case& candidate : candidates) {
+			if (!this->check(candidate).empty()) {
+				testCase = candidate;
+				shrunk = true;
+				break;
+			}
+		}
+	}
+}
+
+/* Writes the case so that it can be reproduced: a kernel case as its limit
+ * and number of parts followed by the parameters in the format read by the
+ * daemon, and any other as its arguments followed by each of its series as
+ * its nonzero coefficients. */
+void Fuzzer::write(Case& testCase, std::ostream& stream)
+{
+	const char *names[FuzzKinds] = {"kernel", "factorize", "qPochhammer",
+									"qBinomial"};
+
+	stream << names[testCase.kind];
+
+	if (testCase.kind == FuzzKernel) {
+		stream << ' ' << testCase.arguments[0] << ' '
+			   << testCase.arguments[1] << "\n";
+		testCase.parameters.write(stream);
+		stream << '\n';
+		return;
+	}
+
+	for (int index = 0; index < 5; ++index) {
+		stream << ' ' << testCase.arguments[index];
+	}
+
+	stream << '\n';
+
+	for (QSeries& series : testCase.series) {
+		bool first = true;
+
+		for (int index = 0; index < series.limit; ++index) {
+			if (series.coefficients[index] != 0) {
+				stream << (first ? "" : " ") << "q^" << index << ':'
+					   << series.coefficients[index];
+				first = false;
+			}
+		}
+
+		stream << '\n';
+	}
+}
+
+/* Checks the given number of cases drawn from FuzzSeed, or given 0, soaks
+ * from a fresh seed until a case disagrees, reporting progress on standard
+ * error. The first case that disagrees is shrunk and written out, and
+ * false is returned. */
+bool Fuzzer::run(long cases)
+{
+	unsigned long seed = cases > 0 ? FuzzSeed : std::random_device()();
+
+	this->random.seed(seed);
+	std::cout << "% Fuzzing from seed " << seed << ".\n";
+
+	for (long index = 0; cases == 0 || index < cases; ++index) {
+		Case testCase = this->randomCase(cases == 0);
+		std::string mismatch = this->check(testCase);
+
+		if (cases == 0 && (index + 1) % FuzzProgressInterval == 0) {
+			std::cerr << index + 1 << " cases agree.\n";
+		}
+
+		if (mismatch.empty()) {
+			continue;
+		}
+
+		std::cout << "% Case " << index << ": " << mismatch << ".\n";
+		this->shrink(testCase);
+		std::cout << "% Shrunk: " << this->check(testCase) << ".\n";
+		this->write(testCase, std::cout);
+		return false;
+	}
+
+	std::cout << "% All " << cases << " cases agree.\n";
+	return true;
+}
+
+};
@@ -1,18 +1,9 @@
-#include <mutex>
+#include <algorithm>
+#include <iostream>
 #include "bqspc.h"
 
 namespace bqspc {
 
-/* These constants define the largest values the generator will allow for
- * the respective parameters. */
-const static int Max_qScalarsDegree1 = 2;
-const static int Max_qScalarsDegree2Pure = 2;
-const static int Max_qScalarsDegree2Mixed = 2;
-const static int Max_qPS_power = 2;
-const static int Max_qPS_dilation1 = 2;
-const static int Max_qPS_dilation2 = 2;
-const static int Max_qPS_subScalars = 2;
-
 /* Advances the state of the generator. */
 void ParameterGenerator::advance(void)
 {
@@ -20,7 +11,7 @@ void ParameterGenerator::advance(void)
 	for (int index = 0; index < this->indicesInUse; ++index) {
 		this->qScalarsDegree1[index]++;
 
-		if (this->qScalarsDegree1[index] <= Max_qScalarsDegree1) {
+		if (this->qScalarsDegree1[index] <= this->bounds.Max_qScalarsDegree1) {
 			return;
 		}
 		
@@ -30,7 +21,9 @@ void ParameterGenerator::advance(void)
 	for (int index = 0; index < this->indicesInUse; ++index) {
 		this->qScalarsDegree2Pure[index]++;
 
-		if (this->qScalarsDegree2Pure[index] <= Max_qScalarsDegree2Pure) {
+		if (this->qScalarsDegree2Pure[index]
+			<= this->bounds.Max_qScalarsDegree2Pure) {
+
 			return;
 		}
 		
@@ -42,7 +35,9 @@ void ParameterGenerator::advance(void)
 
 		this->qScalarsDegree2Mixed[index]++;
 
-		if (this->qScalarsDegree2Mixed[index] <= Max_qScalarsDegree2Mixed) {
+		if (this->qScalarsDegree2Mixed[index]
+			<= this->bounds.Max_qScalarsDegree2Mixed) {
+
 			return;
 		}
 		
@@ -56,14 +51,14 @@ void ParameterGenerator::advance(void)
 	for (int nIndex = 0; nIndex < this->qPSInUse; ++nIndex) {
 		this->qPS[nIndex].dilation1++;
 
-		if (this->qPS[nIndex].dilation1 <= Max_qPS_dilation1) {
+		if (this->qPS[nIndex].dilation1 <= this->bounds.Max_qPS_dilation1) {
 			return;
 		}
 
 		this->qPS[nIndex].dilation1 = 1;
 		this->qPS[nIndex].dilation2++;
 
-		if (this->qPS[nIndex].dilation2 <= Max_qPS_dilation2) {
+		if (this->qPS[nIndex].dilation2 <= this->bounds.Max_qPS_dilation2) {
 			return;
 		}
 
@@ -79,17 +74,19 @@ void ParameterGenerator::advance(void)
 			this->qPS[nIndex].negativePrefix = true;
 		}
 
-		if (this->qPS[nIndex].power <= Max_qPS_power) {
+		if (this->qPS[nIndex].power <= this->bounds.Max_qPS_power) {
 			return;
 		}
 
-		this->qPS[nIndex].power = -Max_qPS_power;
+		this->qPS[nIndex].power = -this->bounds.Max_qPS_power;
 
 		/* Generate the function $s_i(n_0, \dots n_\ell)$. */
 		for (int kIndex = 0; kIndex < this->indicesInUse; ++kIndex) {
 			this->qPS[nIndex].subScalars[kIndex]++;
 
-			if (this->qPS[nIndex].subScalars[kIndex] <= Max_qPS_subScalars) {
+			if (this->qPS[nIndex].subScalars[kIndex]
+				<= this->bounds.Max_qPS_subScalars) {
+
 				return;
 			}
 
@@ -99,49 +96,518 @@ void ParameterGenerator::advance(void)
 		this->qPS[nIndex].subScalars[0] = 1;
 	}
 
+	/* The dilation of the $q$-binomial factor, if there is one. */
+	if (this->qBinomialDilation > 0) {
+		this->qBinomialDilation++;
+
+		if (this->qBinomialDilation <= this->bounds.Max_qBinomial_dilation) {
+			return;
+		}
+
+		this->qBinomialDilation = 1;
+	}
+
 	/* Number of $q$-Pochhammer symbols. */
 	this->qPSInUse++;
 
-	if (this->qPSInUse <= MaxQPS) return;
+	if (this->qPSInUse <= this->bounds.Max_qPSInUse) return;
 
 	this->qPSInUse = 0;
 
 	/* Number of indices. */
 	this->indicesInUse++;
 
-	if (this->indicesInUse <= MaxIndices) return;
+	if (this->indicesInUse <= this->bounds.Max_indicesInUse) return;
+
+	/* Every shape is then given out again with a $q$-binomial factor, which
+	 * needs two indices. */
+	if (this->qBinomialDilation == 0 && this->bounds.Max_qBinomial_dilation > 0
+		&& this->bounds.Max_indicesInUse > 1) {
+
+		this->qBinomialDilation = 1;
+		this->indicesInUse = std::max(this->bounds.Min_indicesInUse, 2);
+		return;
+	}
 
 	/* When this is reached, we have exhausted every parameter combination. */
 	this->continueWorking = false;
 }
 
-/* Must be held whenever the state of the generator is accessed in any way. */
-static std::mutex generatorLock;
+/* Returns the product of two counts, or -1 if either is -1 or the product
+ * does not fit in a long. */
+static long countProduct(long first, long second)
+{
+	long product;
+
+	if (first < 0 || second < 0
+		|| __builtin_mul_overflow(first, second, &product)) {
+
+		return -1;
+	}
 
-/* Gives the worker thread some jobs. */
-void ParameterGenerator::populate(WorkerThread& worker)
+	return product;
+}
+
+/* Returns base raised to a nonnegative power, or -1 if that does not fit in
+ * a long. */
+static long integerPower(long base, int power)
 {
-	/* This is the only place where the mutex needs to be held. */
-	std::scoped_lock<std::mutex> lock(generatorLock);
+	long result = 1;
 
-	worker.jobQueueLength = 0;
+	for (int index = 0; index < power; ++index) {
+		result = countProduct(result, base);
+	}
 
-	while (this->continueWorking) {
-		*worker.jobQueue[worker.jobQueueLength++] = *this;
-		if (worker.jobQueueLength == JobQueueLimit) break;
+	return result;
+}
+
+/* The number of functions $c(n_0, \dots, n_\ell)$ generated for the given
+ * number of indices, leaving out the one that is identically zero, or -1 if
+ * that does not fit in a long. */
+static long scalarsCount(const SearchBounds& bounds, int indices)
+{
+	long count = countProduct(countProduct(
+		integerPower(bounds.Max_qScalarsDegree1 + 1, indices),
+		integerPower(bounds.Max_qScalarsDegree2Pure + 1, indices)),
+		integerPower(bounds.Max_qScalarsDegree2Mixed + 1,
+					 indices * (indices - 1) / 2));
+
+	return count < 0 ? -1 : count - 1;
+}
+
+/* The number of distinct $q$-Pochhammer symbols generated for the given
+ * number of indices, leaving out subscripts that are identically zero, or
+ * -1 if that does not fit in a long. */
+static long qPSCount(const SearchBounds& bounds, int indices)
+{
+	long subScalars = integerPower(bounds.Max_qPS_subScalars + 1, indices);
+
+	return countProduct(static_cast<long>(bounds.Max_qPS_dilation1)
+						* bounds.Max_qPS_dilation2 * 2 * bounds.Max_qPS_power,
+						subScalars < 0 ? -1 : subScalars - 1);
+}
+
+/* Returns the number of combinations of the given shape the generator
+ * gives out, which are all given out one after another, or -1 if that does
+ * not fit in a long, which SearchBounds::read rules out. */
+long ParameterGenerator::shapeSize(int shape)
+{
+	int indices = Parameters::shapeIndices(shape);
+	int qPS = Parameters::shapeQPS(shape);
+	long size;
+
+	if (indices < this->bounds.Min_indicesInUse
+		|| indices > this->bounds.Max_indicesInUse
+		|| qPS > this->bounds.Max_qPSInUse) {
+
+		return 0;
+	}
+
+	size = countProduct(scalarsCount(this->bounds, indices),
+						integerPower(qPSCount(this->bounds, indices), qPS));
+
+	if (Parameters::shapeQBinomial(shape)) {
+		return indices > 1
+			? countProduct(size, this->bounds.Max_qBinomial_dilation) : 0;
+	}
+
+	return size;
+}
+
+/* Returns the number of combinations the generator gives out in all, or -1
+ * if that or the number of some shape does not fit in a long. */
+long ParameterGenerator::combinations(void)
+{
+	long total = 0;
+
+	for (int shape = 0; shape < ShapeCount; ++shape) {
+		long size = this->shapeSize(shape);
+
+		if (size < 0 || __builtin_add_overflow(total, size, &total)) {
+			return -1;
+		}
+	}
+
+	return total;
+}
+
+/* Returns the position of the first combination of the given shape in the
+ * order of the generator. */
+long ParameterGenerator::shapeStart(int shape)
+{
+	long position = 0;
+
+	for (int index = 0; index < shape; ++index) {
+		position += this->shapeSize(index);
+	}
+
+	return position;
+}
+
+/* Returns the number of combinations in each region of the given shape,
+ * which is a run of combinations sharing the dilation of the $q$-binomial
+ * factor and the most significant $q$-Pochhammer symbol, or the whole shape
+ * if it has neither. */
+long ParameterGenerator::regionSize(int shape)
+{
+	int indices = Parameters::shapeIndices(shape);
+	int qPS = Parameters::shapeQPS(shape);
+
+	if (this->shapeSize(shape) == 0) return 0;
+
+	if (qPS == 0 && !Parameters::shapeQBinomial(shape)) {
+		return this->shapeSize(shape);
+	}
+
+	return countProduct(scalarsCount(this->bounds, indices),
+						integerPower(qPSCount(this->bounds, indices),
+									 std::max(qPS - 1, 0)));
+}
+
+/* Writes value + 1 in mixed radix base + 1 into the digits, least
+ * significant first, which is the order advance counts them in. */
+static void decodeDigits(long value, int base, int *digits, int length)
+{
+	value++;
+
+	for (int index = 0; index < length; ++index) {
+		digits[index] = value % (base + 1);
+		value /= base + 1;
+	}
+}
+
+/* Moves the generator to the given position in its order, counting from 0
+ * at the start, or to the end if there are not that many combinations. The
+ * position is decoded directly into the state advance would have reached,
+ * so the position names the same combination for as long as the bounds
+ * stay the same. */
+void ParameterGenerator::seek(long position)
+{
+	int shape = 0;
+
+	ParameterGenerator *excluded = this->excluded;
+
+	*this = ParameterGenerator(this->bounds);
+	this->excluded = excluded;
+
+	while (shape < ShapeCount && position >= this->shapeSize(shape)) {
+		position -= this->shapeSize(shape++);
+	}
+
+	if (shape == ShapeCount) {
+		this->continueWorking = false;
+		return;
+	}
+
+	this->indicesInUse = Parameters::shapeIndices(shape);
+	this->qPSInUse = Parameters::shapeQPS(shape);
+
+	int indices = this->indicesInUse;
+	long scalars = scalarsCount(this->bounds, indices);
+	long qPS = qPSCount(this->bounds, indices);
+	int digits[MaxIndices];
+
+	/* First the function $c(n_0, \dots, n_\ell)$, counting every
+	 * coefficient as one digit. Its digits are decoded together, since
+	 * only the combination of all zeros is left out. */
+	long value = position % scalars + 1;
+
+	position /= scalars;
+
+	for (int index = 0; index < indices; ++index) {
+		this->qScalarsDegree1[index] = value
+									 % (this->bounds.Max_qScalarsDegree1 + 1);
+		value /= this->bounds.Max_qScalarsDegree1 + 1;
+	}
+
+	for (int index = 0; index < indices; ++index) {
+		this->qScalarsDegree2Pure[index]
+			= value % (this->bounds.Max_qScalarsDegree2Pure + 1);
+		value /= this->bounds.Max_qScalarsDegree2Pure + 1;
+	}
+
+	for (int index = 0; index < indices * (indices - 1) / 2; ++index) {
+		this->qScalarsDegree2Mixed[index]
+			= value % (this->bounds.Max_qScalarsDegree2Mixed + 1);
+		value /= this->bounds.Max_qScalarsDegree2Mixed + 1;
+	}
+
+	/* The $q$-Pochhammer symbols, each counting its dilations, power and
+	 * subscript from least to most significant, and then the dilation of
+	 * the $q$-binomial factor. */
+	for (int nIndex = 0; nIndex < MaxQPS; ++nIndex) {
+		long subscript = 0;
+		int power = 0;
+
+		if (nIndex < this->qPSInUse) {
+			long symbol = position % qPS;
+
+			position /= qPS;
+			this->qPS[nIndex].dilation1 = symbol
+										% this->bounds.Max_qPS_dilation1 + 1;
+			symbol /= this->bounds.Max_qPS_dilation1;
+			this->qPS[nIndex].dilation2 = symbol
+										% this->bounds.Max_qPS_dilation2 + 1;
+			symbol /= this->bounds.Max_qPS_dilation2;
+			power = symbol % (2 * this->bounds.Max_qPS_power);
+			subscript = symbol / (2 * this->bounds.Max_qPS_power);
+
+			this->qPS[nIndex].power = power < this->bounds.Max_qPS_power
+									? power - this->bounds.Max_qPS_power
+									: power - this->bounds.Max_qPS_power + 1;
+			decodeDigits(subscript, this->bounds.Max_qPS_subScalars, digits,
+						 indices);
+
+			for (int kIndex = 0; kIndex < indices; ++kIndex) {
+				this->qPS[nIndex].subScalars[kIndex] = digits[kIndex];
+			}
+		}
+
+		/* Advance only updates the prefix when it changes the power, so
+		 * at the lowest power the prefix is left from the last power of
+		 * the cycle before. It is still false only until the symbol has
+		 * been through its powers once, which happened earlier in this
+		 * shape if any more significant digit is nonzero, or in a shape
+		 * before it that used the symbol, which all shapes with a
+		 * $q$-binomial factor come after. */
+		if (this->qPS[nIndex].power > 0) {
+			this->qPS[nIndex].negativePrefix = true;
+		} else if (this->qPS[nIndex].power > -this->bounds.Max_qPS_power) {
+			this->qPS[nIndex].negativePrefix = false;
+		} else {
+			this->qPS[nIndex].negativePrefix = (nIndex < this->qPSInUse
+				&& (subscript > 0 || position > 0
+					|| nIndex < this->qPSInUse - 1))
+				|| ((indices > this->bounds.Min_indicesInUse
+					 || Parameters::shapeQBinomial(shape))
+					&& nIndex < this->bounds.Max_qPSInUse);
+		}
+	}
+
+	if (Parameters::shapeQBinomial(shape)) {
+		this->qBinomialDilation = position + 1;
+	}
+}
+
+/* Returns the position of the parameters in the order of the generator,
+ * which seek moves back to. The parameters must be ones the generator gives
+ * out. */
+long ParameterGenerator::position(Parameters& parameters)
+{
+	int shape = parameters.shape();
+	int indices = parameters.indicesInUse;
+	long position = 0;
+	long value = 0;
+
+	/* From the most significant digit down, so each step scales what is
+	 * already there by the radix of the next digit. */
+	if (parameters.qBinomialDilation > 0) {
+		position = parameters.qBinomialDilation - 1;
+	}
+
+	for (int nIndex = parameters.qPSInUse - 1; nIndex >= 0; --nIndex) {
+		auto& symbol = parameters.qPS[nIndex];
+		long subscript = 0;
+		long digit;
+
+		for (int kIndex = indices - 1; kIndex >= 0; --kIndex) {
+			subscript = subscript * (this->bounds.Max_qPS_subScalars + 1)
+					  + symbol.subScalars[kIndex];
+		}
+
+		/* As in seek, the subscript that is identically zero and the power
+		 * of 0 are left out. */
+		digit = (subscript - 1) * 2 * this->bounds.Max_qPS_power
+			  + symbol.power + this->bounds.Max_qPS_power
+			  - (symbol.power > 0);
+		digit = (digit * this->bounds.Max_qPS_dilation2 + symbol.dilation2
+				 - 1) * this->bounds.Max_qPS_dilation1 + symbol.dilation1 - 1;
+		position = position * qPSCount(this->bounds, indices) + digit;
+	}
+
+	for (int index = indices * (indices - 1) / 2 - 1; index >= 0; --index) {
+		value = value * (this->bounds.Max_qScalarsDegree2Mixed + 1)
+			  + parameters.qScalarsDegree2Mixed[index];
+	}
+
+	for (int index = indices - 1; index >= 0; --index) {
+		value = value * (this->bounds.Max_qScalarsDegree2Pure + 1)
+			  + parameters.qScalarsDegree2Pure[index];
+	}
+
+	for (int index = indices - 1; index >= 0; --index) {
+		value = value * (this->bounds.Max_qScalarsDegree1 + 1)
+			  + parameters.qScalarsDegree1[index];
+	}
+
+	return this->shapeStart(shape)
+		 + position * scalarsCount(this->bounds, indices) + value - 1;
+}
+
+/* Returns whether the generator gives out the parameters. Besides being
+ * within the bounds, the prefix of every $q$-Pochhammer symbol must be the
+ * one the generator gives it, which at the lowest power depends on the
+ * position, as described in seek. */
+bool ParameterGenerator::gives(Parameters& parameters)
+{
+	int indices = parameters.indicesInUse;
+	bool lowestPower = false;
+	long value = 0;
+
+	if (indices < 1 || indices > MaxIndices || parameters.qPSInUse < 0
+		|| parameters.qPSInUse > MaxQPS
+		|| parameters.qBinomialDilation < 0
+		|| parameters.qBinomialDilation
+		   > this->bounds.Max_qBinomial_dilation
+		|| this->shapeSize(parameters.shape()) == 0) {
+
+		return false;
+	}
+
+	for (int index = 0; index < indices; ++index) {
+		if (parameters.qScalarsDegree1[index] < 0
+			|| parameters.qScalarsDegree1[index]
+			   > this->bounds.Max_qScalarsDegree1
+			|| parameters.qScalarsDegree2Pure[index] < 0
+			|| parameters.qScalarsDegree2Pure[index]
+			   > this->bounds.Max_qScalarsDegree2Pure) {
+
+			return false;
+		}
+
+		value += parameters.qScalarsDegree1[index]
+			   + parameters.qScalarsDegree2Pure[index];
+	}
+
+	for (int index = 0; index < indices * (indices - 1) / 2; ++index) {
+		if (parameters.qScalarsDegree2Mixed[index] < 0
+			|| parameters.qScalarsDegree2Mixed[index]
+			   > this->bounds.Max_qScalarsDegree2Mixed) {
+
+			return false;
+		}
+
+		value += parameters.qScalarsDegree2Mixed[index];
+	}
+
+	if (value == 0) return false;
+
+	for (int nIndex = 0; nIndex < parameters.qPSInUse; ++nIndex) {
+		auto& symbol = parameters.qPS[nIndex];
+		long subscript = 0;
+
+		if (symbol.dilation1 < 1
+			|| symbol.dilation1 > this->bounds.Max_qPS_dilation1
+			|| symbol.dilation2 < 1
+			|| symbol.dilation2 > this->bounds.Max_qPS_dilation2
+			|| symbol.power == 0
+			|| symbol.power < -this->bounds.Max_qPS_power
+			|| symbol.power > this->bounds.Max_qPS_power) {
+
+			return false;
+		}
+
+		for (int kIndex = 0; kIndex < indices; ++kIndex) {
+			if (symbol.subScalars[kIndex] < 0
+				|| symbol.subScalars[kIndex]
+				   > this->bounds.Max_qPS_subScalars) {
+
+				return false;
+			}
+
+			subscript += symbol.subScalars[kIndex];
+		}
+
+		if (subscript == 0) return false;
+
+		if (symbol.power == -this->bounds.Max_qPS_power) {
+			lowestPower = true;
+		} else if (symbol.negativePrefix != (symbol.power > 0)) {
+			return false;
+		}
+	}
+
+	if (!lowestPower) return true;
+
+	ParameterGenerator probe(this->bounds);
+
+	probe.seek(this->position(parameters));
+
+	for (int nIndex = 0; nIndex < parameters.qPSInUse; ++nIndex) {
+		if (probe.qPS[nIndex].negativePrefix
+			!= parameters.qPS[nIndex].negativePrefix) {
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Advances past the combinations the excluded generator gives out. */
+void ParameterGenerator::skipExcluded(void)
+{
+	while (this->continueWorking && this->excluded != nullptr
+		   && this->excluded->gives(*this)) {
 
 		this->advance();
 	}
 }
 
-/* Sets all the parameters to their initial state. */
-ParameterGenerator::ParameterGenerator(void)
+/* Skips the combinations the given generator gives out from then on, or
+ * none if it is nullptr. */
+void ParameterGenerator::exclude(ParameterGenerator *generator)
+{
+	this->excluded = generator;
+}
+
+/* Gives out the next count parameter combinations in order. */
+int ParameterGenerator::populate(std::deque<Parameters>& queue, int count)
+{
+	int length = 0;
+
+	this->skipExcluded();
+
+	while (this->continueWorking && length < count) {
+		queue.push_back(*this);
+		++length;
+		this->advance();
+		this->skipExcluded();
+	}
+
+	return length;
+}
+
+/* The shape of the next combination the generator gives out. */
+int ParameterGenerator::nextShape(void)
+{
+	this->skipExcluded();
+
+	return this->continueWorking ? this->shape() : -1;
+}
+
+/* Identities found are reported right away. */
+void ParameterGenerator::finish(WorkerThread& worker, Parameters& parameters,
+								ProductSignature& signature, bool identity,
+								long)
+{
+	if (identity) {
+		worker.reportIdentity(parameters, signature, std::cout);
+	}
+}
+
+/* Sets all the parameters to their initial state within the given
+ * bounds. */
+ParameterGenerator::ParameterGenerator(const SearchBounds& bounds)
 {
 	this->continueWorking = true;
+	this->bounds = bounds;
+	this->excluded = nullptr;
 	this->alternatingSign = false;
 	this->dividePowerBy2 = false;
-	this->indicesInUse = 2;
+	this->indicesInUse = this->bounds.Min_indicesInUse;
 	this->qPSInUse = 0;
+	this->qBinomialDilation = 0;
 
 	for (int index = 0; index < MaxIndices; ++index) {
 		this->qScalarsDegree1[index] = 0;
@@ -158,7 +624,7 @@ ParameterGenerator::ParameterGenerator(void)
 		this->qPS[nIndex].dilation1 = 1;
 		this->qPS[nIndex].dilation2 = 1;
 		this->qPS[nIndex].negativePrefix = false;
-		this->qPS[nIndex].power = -Max_qPS_power;
+		this->qPS[nIndex].power = -this->bounds.Max_qPS_power;
 
 		for (int kIndex = 1; kIndex < MaxIndices; ++kIndex) {
 			this->qPS[nIndex].subScalars[kIndex] = 0;
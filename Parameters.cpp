@@ -0,0 +1,280 @@
+#include <istream>
+#include <numeric>
+#include <ostream>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Returns whether some summation index appears in no term of
+ * $c(n_0, \dots, n_\ell)$ except mixed ones, so that $c$ stays zero along
+ * it and the sum does not converge as a power series, having infinitely
+ * many terms at every power. The index is fine if a factor
+ * $(1;q^b)_{s(n_0, \dots, n_\ell)}^p$ with $p > 0$ vanishes whenever the
+ * index is nonzero, and $n_1$ is fine with a $q$-binomial factor, which
+ * vanishes once $n_1$ passes $n_0$. */
+bool Parameters::hasFlatAxis(void)
+{
+	for (int index = 0; index < this->indicesInUse; ++index) {
+		bool vanishes = false;
+
+		if (this->qScalarsDegree1[index] != 0
+			|| this->qScalarsDegree2Pure[index] != 0) {
+
+			continue;
+		}
+
+		if (index == 1 && this->qBinomialDilation > 0) continue;
+
+		for (int nIndex = 0; nIndex < this->qPSInUse; ++nIndex) {
+			if (this->qPS[nIndex].dilation1 == 0
+				&& !this->qPS[nIndex].negativePrefix
+				&& this->qPS[nIndex].power > 0
+				&& this->qPS[nIndex].subScalars[index] > 0) {
+
+				vanishes = true;
+			}
+		}
+
+		if (!vanishes) return true;
+	}
+
+	return false;
+}
+
+/* Returns a common divisor of every power of $q$ the $q$-series can have,
+ * so that it is $f(q^d)$ for some power series $f$ if the result $d$ is
+ * greater than 1. As $c$ has degree at most 2 in each index, every one of
+ * its values is an integer combination of its values at indices from 0 to
+ * 2, so their greatest common divisor divides every value of $c$. Each
+ * $q$-Pochhammer symbol only adds multiples of its dilations, and the
+ * $q$-binomial factor multiples of its own. */
+long Parameters::powerGCD(void)
+{
+	int indices[MaxIndices] = {};
+	long gcd = 0;
+
+	for (;;) {
+		long power = 0;
+		int index;
+
+		for (int nIndex = 0; nIndex < this->indicesInUse; ++nIndex) {
+			power += this->qScalarsDegree1[nIndex] * indices[nIndex]
+				   + this->qScalarsDegree2Pure[nIndex]
+				   * indices[nIndex] * indices[nIndex];
+
+			for (int kIndex = nIndex + 1; kIndex < this->indicesInUse;
+				 ++kIndex) {
+
+				int mIndex = nIndex * (this->indicesInUse - 1)
+						   - nIndex * (nIndex + 1) / 2 + kIndex - 1;
+
+				power += this->qScalarsDegree2Mixed[mIndex]
+					   * indices[nIndex] * indices[kIndex];
+			}
+		}
+
+		/* Halving is only exact when every value is even. */
+		if (this->dividePowerBy2) {
+			if (power % 2 != 0) return 1;
+
+			power /= 2;
+		}
+
+		gcd = std::gcd(gcd, power);
+
+		for (index = 0; index < this->indicesInUse; ++index) {
+			if (++indices[index] <= 2) break;
+
+			indices[index] = 0;
+		}
+
+		if (index == this->indicesInUse) break;
+	}
+
+	for (int nIndex = 0; nIndex < this->qPSInUse; ++nIndex) {
+		gcd = std::gcd(gcd, static_cast<long>(this->qPS[nIndex].dilation1));
+		gcd = std::gcd(gcd, static_cast<long>(this->qPS[nIndex].dilation2));
+	}
+
+	gcd = std::gcd(gcd, static_cast<long>(this->qBinomialDilation));
+
+	return gcd;
+}
+
+/* Writes the canonical encoding of the parameters, in which every entry
+ * that is not in use is zero, so that two sets of parameters describing the
+ * same $q$-series in the same way have equal encodings. */
+void Parameters::encode(int (&key)[ParametersKeyLength])
+{
+	int length = 0;
+
+	for (int index = 0; index < ParametersKeyLength; ++index) {
+		key[index] = 0;
+	}
+
+	key[length++] = this->alternatingSign;
+	key[length++] = this->dividePowerBy2;
+	key[length++] = this->indicesInUse;
+	key[length++] = this->qPSInUse;
+	key[length++] = this->qBinomialDilation;
+
+	for (int index = 0; index < MaxIndices; ++index, length += 2) {
+		if (index >= this->indicesInUse) continue;
+
+		key[length] = this->qScalarsDegree1[index];
+		key[length + 1] = this->qScalarsDegree2Pure[index];
+	}
+
+	for (int index = 0; index < MaxIndices * (MaxIndices - 1) / 2;
+		 ++index, ++length) {
+
+		if (index >= this->indicesInUse * (this->indicesInUse - 1) / 2) {
+			continue;
+		}
+
+		key[length] = this->qScalarsDegree2Mixed[index];
+	}
+
+	for (int nIndex = 0; nIndex < MaxQPS; ++nIndex, length += 4 + MaxIndices) {
+		if (nIndex >= this->qPSInUse) continue;
+
+		key[length] = this->qPS[nIndex].dilation1;
+		key[length + 1] = this->qPS[nIndex].dilation2;
+		key[length + 2] = this->qPS[nIndex].negativePrefix;
+		key[length + 3] = this->qPS[nIndex].power;
+
+		for (int kIndex = 0; kIndex < this->indicesInUse; ++kIndex) {
+			key[length + 4 + kIndex] = this->qPS[nIndex].subScalars[kIndex];
+		}
+	}
+}
+
+/* Reads parameters written as integers separated by whitespace, in the
+ * order indicesInUse, qPSInUse, alternatingSign, dividePowerBy2, then the
+ * in use entries of qScalarsDegree1, qScalarsDegree2Pure and
+ * qScalarsDegree2Mixed, then for each $q$-Pochhammer symbol in use its
+ * dilation1, dilation2, negativePrefix, power and in use subScalars, and
+ * last qBinomialDilation, which may be left out when it is zero. Returns
+ * false if the stream ends early or the values are out of range, which
+ * includes any negative coefficient of $c$ or $s_i$, since evaluating the
+ * $q$-series relies on them being non-negative, any dilation2 of 0, which
+ * makes a power of one factor rather than a $q$-Pochhammer symbol, and any
+ * power of a $q$-Pochhammer symbol past MaxQPSPower in magnitude. */
+bool Parameters::read(std::istream& stream)
+{
+	int alternating;
+	int divide;
+	int negative;
+	int mixedCount;
+	int *scalars[3] = {this->qScalarsDegree1, this->qScalarsDegree2Pure,
+					   this->qScalarsDegree2Mixed};
+
+	/* Anything larger than this is truncated away entirely, and only
+	 * serves to make evaluation slow. */
+	auto inRange = [](int value, int minimum) {
+		return value >= minimum && value <= MaxVerificationLimit;
+	};
+
+	if (!(stream >> this->indicesInUse >> this->qPSInUse >> alternating
+		  >> divide)
+		|| this->indicesInUse < 1 || this->indicesInUse > MaxIndices
+		|| this->qPSInUse < 0 || this->qPSInUse > MaxQPS
+		|| !inRange(alternating, 0) || alternating > 1
+		|| !inRange(divide, 0) || divide > 1) {
+		return false;
+	}
+
+	this->alternatingSign = alternating;
+	this->dividePowerBy2 = divide;
+	mixedCount = this->indicesInUse * (this->indicesInUse - 1) / 2;
+
+	for (int kind = 0; kind < 3; ++kind) {
+		int count = kind == 2 ? mixedCount : this->indicesInUse;
+
+		for (int index = 0; index < count; ++index) {
+			if (!(stream >> scalars[kind][index])
+				|| !inRange(scalars[kind][index], 0)) {
+				return false;
+			}
+		}
+	}
+
+	for (int nIndex = 0; nIndex < this->qPSInUse; ++nIndex) {
+		if (!(stream >> this->qPS[nIndex].dilation1
+			  >> this->qPS[nIndex].dilation2 >> negative
+			  >> this->qPS[nIndex].power)
+			|| !inRange(this->qPS[nIndex].dilation1, 0)
+			|| !inRange(this->qPS[nIndex].dilation2, 1)
+			|| !inRange(negative, 0) || negative > 1
+			|| this->qPS[nIndex].power < -MaxQPSPower
+			|| this->qPS[nIndex].power > MaxQPSPower) {
+			return false;
+		}
+
+		/* A factor of $1 - 1$ or $1 + 1$ cannot be divided out. */
+		if (this->qPS[nIndex].dilation1 == 0
+			&& this->qPS[nIndex].power < 0) {
+			return false;
+		}
+
+		this->qPS[nIndex].negativePrefix = negative;
+
+		for (int kIndex = 0; kIndex < this->indicesInUse; ++kIndex) {
+			if (!(stream >> this->qPS[nIndex].subScalars[kIndex])
+				|| !inRange(this->qPS[nIndex].subScalars[kIndex], 0)) {
+				return false;
+			}
+		}
+	}
+
+	/* The $q$-binomial factor is optional, so that lines written before
+	 * there was one still read the same. */
+	this->qBinomialDilation = 0;
+
+	if (!(stream >> this->qBinomialDilation)) {
+		this->qBinomialDilation = 0;
+		stream.clear(stream.rdstate() & ~std::ios::failbit);
+	} else if (!inRange(this->qBinomialDilation, 0)
+			   || (this->qBinomialDilation > 0 && this->indicesInUse < 2)) {
+		return false;
+	}
+
+	return true;
+}
+
+/* Writes the parameters in the format read by read. */
+void Parameters::write(std::ostream& stream)
+{
+	stream << this->indicesInUse << ' ' << this->qPSInUse << ' '
+		   << this->alternatingSign << ' ' << this->dividePowerBy2;
+
+	for (int index = 0; index < this->indicesInUse; ++index) {
+		stream << ' ' << this->qScalarsDegree1[index];
+	}
+
+	for (int index = 0; index < this->indicesInUse; ++index) {
+		stream << ' ' << this->qScalarsDegree2Pure[index];
+	}
+
+	for (int index = 0; index < this->indicesInUse
+		 * (this->indicesInUse - 1) / 2; ++index) {
+		stream << ' ' << this->qScalarsDegree2Mixed[index];
+	}
+
+	for (int nIndex = 0; nIndex < this->qPSInUse; ++nIndex) {
+		stream << ' ' << this->qPS[nIndex].dilation1
+			   << ' ' << this->qPS[nIndex].dilation2
+			   << ' ' << this->qPS[nIndex].negativePrefix
+			   << ' ' << this->qPS[nIndex].power;
+
+		for (int kIndex = 0; kIndex < this->indicesInUse; ++kIndex) {
+			stream << ' ' << this->qPS[nIndex].subScalars[kIndex];
+		}
+	}
+
+	if (this->qBinomialDilation > 0) {
+		stream << ' ' << this->qBinomialDilation;
+	}
+}
+
+};
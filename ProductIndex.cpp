@@ -0,0 +1,160 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Expands the product, after reducing it to its minimal period, and adds it
+ * to the index unless it is there already. */
+void ProductIndex::add(ProductSignature& signature)
+{
+	QSeries expansion;
+
+	signature.reduce();
+	signature.expand(expansion);
+
+	std::vector<long> key(expansion.coefficients,
+						  expansion.coefficients + FingerprintLength);
+	std::vector<int>& bucket = this->prefixes[key];
+	std::vector<long> pattern(signature.powers,
+							  signature.powers + signature.period);
+
+	for (int position : bucket) {
+		if (this->expansions[position] == expansion) return;
+	}
+
+	pattern.insert(pattern.begin(), signature.period);
+	this->patterns.insert(pattern);
+	bucket.push_back(this->products.size());
+	this->products.push_back(signature);
+	this->expansions.push_back(expansion);
+}
+
+/* Reads the products to search for from the file at the given path. Each
+ * line is either blank, a comment starting with #, a product signature
+ * written as "product" followed by a period and powers just as in a
+ * catalog, or "theta" followed by a modulus $M$, or by a smallest and a
+ * largest modulus. The latter stands for the theta quotients
+ * $(q^a, q^{M-a}, q^M; q^M)_\infty / (q; q)_\infty$ for every
+ * $1 \leq a \leq M/2$ and every such modulus, which is the form taken by
+ * the products of the Rogers-Ramanujan and Andrews-Gordon identities.
+ * Returns false and prints the reason if the file cannot be used. */
+bool ProductIndex::load(const char *path)
+{
+	std::ifstream file(path);
+	std::string line;
+	int lineNumber = 0;
+
+	if (!file) {
+		std::cerr << "Cannot open the products " << path << ".\n";
+		return false;
+	}
+
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string kind;
+		std::vector<long> values;
+		long value;
+
+		++lineNumber;
+
+		if (!(fields >> kind) || kind[0] == '#') continue;
+
+		if (kind == "product") {
+			ProductSignature signature;
+
+			if (!signature.read(fields, path, lineNumber)) return false;
+
+			this->add(signature);
+			continue;
+		}
+
+		while (fields >> value) {
+			values.push_back(value);
+		}
+
+		if (!fields.eof()) {
+			std::cerr << path << ":" << lineNumber << ": expected only "
+						 "integers after " << kind << ".\n";
+			return false;
+		}
+
+		if (kind == "theta") {
+			if (values.size() == 1) {
+				values.push_back(values[0]);
+			}
+
+			if (values.size() != 2 || values[0] < 2 || values[0] > values[1]
+				|| values[1] > MaxProductSignatureLength) {
+
+				std::cerr << path << ":" << lineNumber << ": theta needs a "
+							 "modulus, or a range of them, from 2 to "
+						  << MaxProductSignatureLength << ".\n";
+				return false;
+			}
+
+			for (int modulus = values[0]; modulus <= values[1]; ++modulus) {
+				for (int shift = 1; 2 * shift <= modulus; ++shift) {
+					ProductSignature signature;
+
+					/* Dividing by $(q; q)_\infty$ gives every power 1, from
+					 * which the factors of the theta function are taken. */
+					signature.period = modulus;
+
+					for (int index = 0; index < modulus; ++index) {
+						signature.powers[index] = 1;
+					}
+
+					signature.powers[shift - 1]--;
+					signature.powers[modulus - shift - 1]--;
+					signature.powers[modulus - 1]--;
+					this->add(signature);
+				}
+			}
+		} else {
+			std::cerr << path << ":" << lineNumber << ": unknown entry "
+					  << kind << ".\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Looks the $q$-series up among the expanded products, and on finding it
+ * sets the signature to that product, found up to the limit of the series.
+ * The series must have the limit MaxSeriesLimit the products were expanded
+ * to. */
+bool ProductIndex::match(QSeries& series, ProductSignature& signature)
+{
+	std::vector<long> key(series.coefficients,
+						  series.coefficients + FingerprintLength);
+	auto bucket = this->prefixes.find(key);
+
+	if (bucket == this->prefixes.end()) return false;
+
+	for (int position : bucket->second) {
+		if (this->expansions[position] == series) {
+			signature = this->products[position];
+			signature.limit = series.limit;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Checks whether the product signature, in its minimal period, is one of
+ * the products, for sums whose product is known without their series. */
+bool ProductIndex::contains(ProductSignature& signature)
+{
+	std::vector<long> key(signature.powers,
+						  signature.powers + signature.period);
+
+	key.insert(key.begin(), signature.period);
+	return this->patterns.count(key) != 0;
+}
+
+};
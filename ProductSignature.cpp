@@ -1,3 +1,5 @@
+#include <iostream>
+#include <vector>
 #include "bqspc.h"
 
 namespace bqspc {
@@ -20,6 +22,66 @@ long ProductSignature::pairwiseGCD(long value1, long value2)
 	return pairwiseGCD(value2, value1 % value2);
 }
 
+/* Writes the limit up to which the pattern was checked, the period and the
+ * powers of the pattern, separated by spaces, or just 0 if no pattern was
+ * found. */
+void ProductSignature::write(std::ostream& stream)
+{
+	if (this->period == 0) {
+		stream << 0;
+		return;
+	}
+
+	stream << this->limit << ' ' << this->period;
+
+	for (int index = 0; index < this->period; ++index) {
+		stream << ' ' << this->powers[index];
+	}
+}
+
+/* Reads a period $\ell$ followed by the powers $a_1, \dots, a_\ell$, which
+ * must be all that is left in the stream, as written after "product" in a
+ * catalog or a file of products, and reduces the pattern to its minimal
+ * period. Returns false and prints the reason, prefixed by the path and line
+ * number given, if they do not make a product this program can use. */
+bool ProductSignature::read(std::istream& stream, const char *path,
+							int lineNumber)
+{
+	std::vector<long> values;
+	long value;
+	bool inRange = true;
+
+	while (stream >> value) {
+		values.push_back(value);
+
+		if (values.size() > 1
+			&& (value < -MaxProductPower || value > MaxProductPower)) {
+
+			inRange = false;
+		}
+	}
+
+	if (!stream.eof() || values.empty() || values[0] < 1
+		|| values[0] > MaxProductSignatureLength
+		|| static_cast<long>(values.size()) != values[0] + 1 || !inRange) {
+
+		std::cerr << path << ":" << lineNumber << ": a product needs a "
+					 "period of at most " << MaxProductSignatureLength
+				  << " followed by that many powers from "
+				  << -MaxProductPower << " to " << MaxProductPower << ".\n";
+		return false;
+	}
+
+	this->period = values[0];
+
+	for (int index = 0; index < this->period; ++index) {
+		this->powers[index] = values[index + 1];
+	}
+
+	this->reduce();
+	return true;
+}
+
 /* Returns the factor $n \geq 1$ to which the product signature is dilated, or
  * 1 if the product is not dilated. If the product is dilated, that means the
  * product can be expressed $f(q^n)$ where $f(q)$ is a power series in $q$. */
@@ -43,68 +105,129 @@ long ProductSignature::dilation(void)
 	return gcd;
 }
 
-/* The entry precomputedDivisorList[index] is an array containing every
- * divisor of the value index. */
-long *precomputedDivisorList[MaxSeriesLimit];
+/* Shortens the pattern to its minimal period, which is the form factorize
+ * produces. */
+void ProductSignature::reduce(void)
+{
+	for (int period = 1; period < this->period; ++period) {
+		bool success = this->period % period == 0;
+
+		for (int index = period; success && index < this->period; ++index) {
+			success = this->powers[index] == this->powers[index % period];
+		}
+
+		if (success) {
+			this->period = period;
+			return;
+		}
+	}
+}
+
+/* Counts the pairs $d \mid n$ with $1 \leq n < limit$, which is the length
+ * of the flattened divisor lists below. */
+constexpr static int divisorListLength(int limit)
+{
+	int length = 0;
+
+	for (int nIndex = 1; nIndex < limit; ++nIndex) {
+		for (int dIndex = 1; dIndex <= nIndex; ++dIndex) {
+			if (nIndex % dIndex == 0) ++length;
+		}
+	}
+
+	return length;
+}
+
+/* The divisors of every value below Limit in increasing order, stored one
+ * list after another. The divisors of index start at offsets[index] and end
+ * before offsets[index + 1], so the last of them is index itself. */
+template <int Limit>
+struct DivisorTable
+{
+	int offsets[Limit + 1];
+	int divisors[divisorListLength(Limit)];
 
-/* The entry precomputedDivisorFunction[index] is the number of divisors of
- * the value index. */
-int precomputedDivisorFunction[MaxSeriesLimit];
+	constexpr DivisorTable() : offsets(), divisors()
+	{
+		int length = 0;
+
+		offsets[0] = offsets[1] = 0;
+
+		for (int nIndex = 1; nIndex < Limit; ++nIndex) {
+			for (int dIndex = 1; dIndex <= nIndex; ++dIndex) {
+				if (nIndex % dIndex == 0) divisors[length++] = dIndex;
+			}
+
+			offsets[nIndex + 1] = length;
+		}
+	}
+};
+
+/* Generated by the compiler, so nothing has to be set up at startup. */
+constexpr static DivisorTable<MaxSeriesLimit> divisorTable;
 
 /* Factorizes the $q$-series as a product of geometric series of the form
  * $\prod_{n \geq 1} \frac{1}{(1-q^n)^{a_n}}$ using an algorithm found in
  * George Andrews's book The Theory of Partitions, guaranteeing equality for
  * all coefficients before series.limit. The constant coefficient must equal
- * 1 for this to behave correctly. */
+ * 1 for this to behave correctly, and series.limit cannot exceed
+ * MaxSeriesLimit. */
 void ProductSignature::factorize(QSeries& series)
 {
+	BQSPC_TRACE_SCOPE(TraceFactorize);
+
 	long powers[series.limit - 1];
+	long sums[series.limit];
 
 	/* Compute the geometric series powers using dynamic programming. Let
 	 * $r(n)$ be the $n$th q-series coefficient. From the relationship
 	 * $\sum_{n\geq 0} r(n)q^n = \prod_{n\geq 1}\frac{1}{(1-q^n)^{a_n}}$
 	 * we can derive using logarithmic differentiation the recurrence
 	 * $a_n = r(n) - \frac{1}n \sum_{k=1}^{n}r(n-k)
-	 * \times \sum_{d\mid k, d \neq n}d a_d$. This loop computes the values of
-	 * $a_n$ and stores them in powers[n - 1]. */
+	 * \times \sum_{d\mid k, d \neq n}d a_d$. The inner sums
+	 * $b_k = \sum_{d\mid k}d a_d$ are kept in sums[k] once $a_k$ is known,
+	 * making the outer sum one pass over contiguous arrays. This loop
+	 * computes the values of $a_n$ and stores them in powers[n - 1]. */
 	for (int nIndex = 1; nIndex < series.limit; ++nIndex) {
-		long *divisors;
-		int length;
+		const int *divisors = divisorTable.divisors
+							+ divisorTable.offsets[nIndex];
+		int length = divisorTable.offsets[nIndex + 1]
+				   - divisorTable.offsets[nIndex];
 		long power = 0;
+		long sum = 0;
 
 		for (int kIndex = 1; kIndex < nIndex; ++kIndex) {
-			divisors = precomputedDivisorList[kIndex];
-			length = precomputedDivisorFunction[kIndex];
-
-			for (int dIndex = 0; dIndex < length; ++dIndex) {
-				power -= series.coefficients[nIndex - kIndex]
-				      * divisors[dIndex]
-				      * powers[divisors[dIndex] - 1];
-			}
+			power -= series.coefficients[nIndex - kIndex] * sums[kIndex];
 		}
 
-		divisors = precomputedDivisorList[nIndex];
-		length = precomputedDivisorFunction[nIndex];
-
-		/* This handles the special case excluded from the above loop where
-		 * kIndex == nIndex. */
+		/* This handles the special case kIndex == nIndex, where only the
+		 * proper divisors are known so far. */
 		for (int dIndex = 0; dIndex < length - 1; ++dIndex) {
-			power -= divisors[dIndex] * powers[divisors[dIndex] - 1];
+			sum += divisors[dIndex] * powers[divisors[dIndex] - 1];
 		}
 
+		power -= sum;
 		power /= nIndex;
 		power += series.coefficients[nIndex];
 		powers[nIndex - 1] = power;
+		sums[nIndex] = sum + nIndex * power;
 	}
 
-	/* The factorization algorithm is finished now. Proceed to look for a
-	 * repeating pattern. The period is set to 0 if none is found. */
+	/* The factorization algorithm is finished now. */
+	this->findPattern(powers, series.limit);
+}
+
+/* Looks for a repeating pattern in the powers $a_n$ of a factorization,
+ * stored so $a_n$ is at index $n - 1$ for $1 \leq n < limit$. The period is
+ * set to 0 if none is found. */
+void ProductSignature::findPattern(const long *powers, int limit)
+{
 	for (this->period = 1; this->period <= MaxProductSignatureLength;
 	     this->period++) {
 
 		bool success = true;
 
-		for (int index = period; index < series.limit - 1; ++index) {
+		for (int index = period; index < limit - 1; ++index) {
 			if (powers[index] != powers[index % period]) {
 				success = false;
 				break;
@@ -118,6 +241,7 @@ void ProductSignature::factorize(QSeries& series)
 			this->powers[index] = powers[index];
 		}
 
+		this->limit = limit;
 		return;
 	}
 
@@ -126,5 +250,290 @@ void ProductSignature::factorize(QSeries& series)
 	return;
 }
 
+/* Adds to powers, where $a_n$ is at index $n - 1$ for $1 \leq n < limit$,
+ * the powers of the product Euler's identities give for the sum over the
+ * given index of the part of the power of $q$ in that index alone, with the
+ * sign, divided by $(q^b;q^b)_n$ from the given symbol. These are
+ * $\sum_{n \geq 0} \frac{z^n}{(q^b;q^b)_n} = \frac{1}{(z;q^b)_\infty}$ and
+ * $\sum_{n \geq 0} \frac{q^{b\binom{n}{2}} z^n}{(q^b;q^b)_n}
+ * = (-z;q^b)_\infty$, with $z = \pm q^k$ for some $k \geq 1$, both the
+ * cases $a \to 0$ of the $q$-binomial theorem. Returns false if the sum is
+ * not of that form. */
+static bool addEulerProduct(Parameters& parameters, int index, int qPSIndex,
+							int limit, long *powers)
+{
+	auto& symbol = parameters.qPS[qPSIndex];
+	int scale = parameters.dividePowerBy2 ? 2 : 1;
+	int pure = parameters.qScalarsDegree2Pure[index];
+	int linear = parameters.qScalarsDegree1[index];
+	int base = symbol.dilation2;
+	bool alternating = parameters.alternatingSign;
+	bool quadratic = pure != 0;
+	int shift;
+
+	if (symbol.power != -1 || symbol.negativePrefix
+		|| symbol.dilation1 != base) {
+
+		return false;
+	}
+
+	/* The power of $q$ must be $kn$, or $b\binom{n}{2} + kn$, exactly, so
+	 * that halving it never rounds. */
+	if (quadratic) {
+		if (2 * pure != base * scale
+			|| (2 * linear + base * scale) % (2 * scale) != 0) {
+
+			return false;
+		}
+
+		shift = (2 * linear + base * scale) / (2 * scale);
+	} else {
+		if (linear % scale != 0) return false;
+
+		shift = linear / scale;
+	}
+
+	if (shift < 1 || shift >= limit) return false;
+
+	/* A factor $1 - q^m$ has $a_m = -1$, and $1 + q^m$, which is
+	 * $(1 - q^{2m})/(1 - q^m)$, has $a_m = 1$ and $a_{2m} = -1$. Their
+	 * reciprocals have the opposite powers. */
+	for (int m = shift; m < limit; m += base) {
+		int sign = quadratic ? -1 : 1;
+
+		if (alternating == quadratic) {
+			powers[m - 1] += sign;
+			continue;
+		}
+
+		powers[m - 1] -= sign;
+
+		if (2 * m < limit) {
+			powers[2 * m - 1] += sign;
+		}
+	}
+
+	return true;
+}
+
+/* Recognizes sums whose product follows from Euler's identities, which are
+ * those with a power of $q$ that has no mixed terms and with one
+ * $q$-Pochhammer symbol $1/(q^b;q^b)_{n_i}$ for each index $n_i$, possibly
+ * with alternating signs. Such a sum is the product of the sums over each
+ * index alone, each of which addEulerProduct recognizes. For those, the
+ * powers $a_n$ factorize would find in the $q$-series truncated at the
+ * given limit are read off the product instead, and the signature is set to
+ * their pattern, or to period 0 if they have none. Returns the greatest
+ * common divisor of the $n$ with $a_n \neq 0$, which is also that of the
+ * powers of $q$ in the $q$-series, or 0 if the parameters are not
+ * recognized. */
+long ProductSignature::closedForm(Parameters& parameters, int limit)
+{
+	int indices = parameters.indicesInUse;
+	long powers[limit - 1];
+	int symbols[MaxIndices];
+	long gcd = 0;
+
+	if (parameters.qPSInUse != indices || parameters.qBinomialDilation != 0) {
+		return 0;
+	}
+
+	for (int index = 0; index < indices * (indices - 1) / 2; ++index) {
+		if (parameters.qScalarsDegree2Mixed[index] != 0) return 0;
+	}
+
+	for (int index = 0; index < indices; ++index) {
+		symbols[index] = -1;
+	}
+
+	/* Each symbol must run over a different index alone. */
+	for (int nIndex = 0; nIndex < indices; ++nIndex) {
+		int only = -1;
+
+		for (int kIndex = 0; kIndex < indices; ++kIndex) {
+			int subScalar = parameters.qPS[nIndex].subScalars[kIndex];
+
+			if (subScalar == 0) continue;
+
+			if (subScalar != 1 || only >= 0) return 0;
+
+			only = kIndex;
+		}
+
+		if (only < 0 || symbols[only] >= 0) return 0;
+
+		symbols[only] = nIndex;
+	}
+
+	for (int index = 0; index < limit - 1; ++index) {
+		powers[index] = 0;
+	}
+
+	for (int index = 0; index < indices; ++index) {
+		if (!addEulerProduct(parameters, index, symbols[index], limit,
+							 powers)) {
+
+			return 0;
+		}
+	}
+
+	for (int index = 0; index < limit - 1; ++index) {
+		if (powers[index] != 0) {
+			gcd = pairwiseGCD(index + 1, gcd);
+		}
+	}
+
+	this->findPattern(powers, limit);
+	return gcd;
+}
+
+/* Factorizes count $q$-series, up to BatchLanes of them and all with the
+ * same limit, exactly as factorize would one at a time. Their coefficients
+ * are transposed so that the recurrence and the period scan step through
+ * every series side by side, with the series innermost, which the compiler
+ * turns into vector instructions. The recurrence does the same work for
+ * every series, so no lane waits on another. */
+void ProductSignature::factorizeBatch(QSeries **series,
+									  ProductSignature **signatures,
+									  int count)
+{
+	BQSPC_TRACE_SCOPE(TraceFactorize);
+
+	int limit = series[0]->limit;
+	long coefficients[MaxSeriesLimit][BatchLanes];
+	long powers[MaxSeriesLimit][BatchLanes];
+	long sums[MaxSeriesLimit][BatchLanes];
+	int periods[BatchLanes];
+
+	/* Unused lanes are given the series 1, which never holds anything up. */
+	for (int index = 0; index < limit; ++index) {
+		for (int lane = 0; lane < BatchLanes; ++lane) {
+			coefficients[index][lane] = lane < count
+									  ? series[lane]->coefficients[index]
+									  : index == 0;
+		}
+	}
+
+	/* The recurrence of factorize, with $b_k$ in sums[k] as there. */
+	for (int nIndex = 1; nIndex < limit; ++nIndex) {
+		const int *divisors = divisorTable.divisors
+							+ divisorTable.offsets[nIndex];
+		int length = divisorTable.offsets[nIndex + 1]
+				   - divisorTable.offsets[nIndex];
+		long power[BatchLanes] = {};
+		long sum[BatchLanes] = {};
+
+		for (int kIndex = 1; kIndex < nIndex; ++kIndex) {
+			for (int lane = 0; lane < BatchLanes; ++lane) {
+				power[lane] -= coefficients[nIndex - kIndex][lane]
+							 * sums[kIndex][lane];
+			}
+		}
+
+		for (int dIndex = 0; dIndex < length - 1; ++dIndex) {
+			int divisor = divisors[dIndex];
+
+			for (int lane = 0; lane < BatchLanes; ++lane) {
+				sum[lane] += divisor * powers[divisor - 1][lane];
+			}
+		}
+
+		for (int lane = 0; lane < BatchLanes; ++lane) {
+			power[lane] = (power[lane] - sum[lane]) / nIndex
+						+ coefficients[nIndex][lane];
+			powers[nIndex - 1][lane] = power[lane];
+			sums[nIndex][lane] = sum[lane] + nIndex * power[lane];
+		}
+	}
+
+	/* Try each period on every series that has none yet, stopping early
+	 * once the period fails for all of them. */
+	for (int lane = 0; lane < BatchLanes; ++lane) {
+		periods[lane] = 0;
+	}
+
+	for (int period = 1; period <= MaxProductSignatureLength; ++period) {
+		bool holds[BatchLanes];
+		bool any = false;
+
+		for (int lane = 0; lane < BatchLanes; ++lane) {
+			holds[lane] = lane < count && periods[lane] == 0;
+			any |= holds[lane];
+		}
+
+		if (!any) break;
+
+		for (int index = period; any && index < limit - 1; ++index) {
+			any = false;
+
+			for (int lane = 0; lane < BatchLanes; ++lane) {
+				holds[lane] &= powers[index][lane]
+							== powers[index % period][lane];
+				any |= holds[lane];
+			}
+		}
+
+		for (int lane = 0; lane < BatchLanes; ++lane) {
+			if (holds[lane]) periods[lane] = period;
+		}
+	}
+
+	for (int lane = 0; lane < count; ++lane) {
+		ProductSignature& signature = *signatures[lane];
+
+		signature.period = periods[lane];
+
+		if (signature.period == 0) continue;
+
+		for (int index = 0; index < signature.period; ++index) {
+			signature.powers[index] = powers[index][lane];
+		}
+
+		signature.limit = limit;
+	}
+}
+
+/* Sets the $q$-series to the product, truncated at the limit of the
+ * series. */
+void ProductSignature::expand(QSeries& series)
+{
+	series.zero();
+	series.coefficients[0] = 1;
+
+	/* Multiplying 1 by $(1-q^n)^{-a_n}$ for every $n$ below the limit gives
+	 * the truncated product exactly. */
+	for (int nIndex = 1; nIndex < series.limit; ++nIndex) {
+		series.applyFactor(nIndex, false,
+						   -this->powers[(nIndex - 1) % this->period]);
+	}
+}
+
+/* Checks that the pattern found by factorize still holds for a truncation of
+ * the same $q$-series to a larger limit, which is overwritten in the process.
+ * Rather than factorizing again, whose intermediate values overflow quickly
+ * as the limit grows, the conjectured product is divided back out of the
+ * series one factor at a time. Those steps are exact even when coefficients
+ * wrap around, so the identity holds precisely when the result is 1. */
+bool ProductSignature::verify(QSeries& series)
+{
+	BQSPC_TRACE_SCOPE(TraceVerify);
+
+	if (this->period == 0) return false;
+
+	for (int nIndex = 1; nIndex < series.limit; ++nIndex) {
+		series.applyFactor(nIndex, false,
+						   this->powers[(nIndex - 1) % this->period]);
+	}
+
+	if (series.coefficients[0] != 1) return false;
+
+	for (int index = 1; index < series.limit; ++index) {
+		if (series.coefficients[index] != 0) return false;
+	}
+
+	this->limit = series.limit;
+	return true;
+}
+
 };
 
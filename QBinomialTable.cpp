@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <utility>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Returns the table of the calling thread, truncated at no less than the
+ * given limit. Raising the limit of a table starts it over, so every table
+ * starts out at MaxSeriesLimit, which the terms of most series fit in. */
+QBinomialTable& QBinomialTable::local(int limit)
+{
+	thread_local QBinomialTable table;
+
+	limit = std::max(limit, MaxSeriesLimit);
+
+	if (table.limit < limit) {
+		table.limit = limit;
+		table.entries.clear();
+	}
+
+	return table;
+}
+
+/* Returns the coefficients of ${top \brack bottom}_q$, where
+ * $0 \leq bottom \leq top$, computing every row up to top not yet in the
+ * table. The reference is only good until the next call. */
+const std::vector<long>& QBinomialTable::entry(int top, int bottom)
+{
+	int rows = 0;
+
+	while (rows * (rows + 1) / 2 < static_cast<int>(this->entries.size())) {
+		++rows;
+	}
+
+	/* Row $n$ follows from row $n - 1$ by the $q$-Pascal recurrence
+	 * ${n \brack k}_q = {n-1 \brack k-1}_q + q^k{n-1 \brack k}_q$, with
+	 * ${n \brack 0}_q = {n \brack n}_q = 1$. The degree of
+	 * ${n \brack k}_q$ is $k(n - k)$. */
+	for (int nIndex = rows; nIndex <= top; ++nIndex) {
+		int previous = (nIndex - 1) * nIndex / 2;
+
+		this->entries.push_back(std::vector<long>(1, 1));
+
+		for (int kIndex = 1; kIndex < nIndex; ++kIndex) {
+			const std::vector<long>& left = this->entries[previous + kIndex - 1];
+			const std::vector<long>& right = this->entries[previous + kIndex];
+			int length = std::min(static_cast<long>(this->limit),
+								  static_cast<long>(kIndex)
+								  * (nIndex - kIndex) + 1);
+			std::vector<long> coefficients(length, 0);
+
+			for (int index = 0; index < length; ++index) {
+				if (index < static_cast<int>(left.size())) {
+					coefficients[index] = left[index];
+				}
+
+				if (index >= kIndex && index - kIndex
+					< static_cast<int>(right.size())) {
+
+					coefficients[index] += right[index - kIndex];
+				}
+			}
+
+			this->entries.push_back(std::move(coefficients));
+		}
+
+		if (nIndex > 0) {
+			this->entries.push_back(std::vector<long>(1, 1));
+		}
+	}
+
+	return this->entries[top * (top + 1) / 2 + bottom];
+}
+
+};
@@ -1,12 +1,22 @@
+#include <array>
+#include <numeric>
+#include <utility>
 #include "bqspc.h"
 
 namespace bqspc {
 
+/* The largest power applyFactor expands with binomial coefficients. Every
+ * $\binom{power}{j}$ and every product formed while computing them fits in
+ * a long up to a power of 61. */
+const static int MaxWeightedPower = 60;
+
 /* Computes the truncated reciprocal of the $q$-series. This method assumes
  * that the constant coefficient equals 1 since fractional coefficients are
  * not supported. */
 void QSeries::reciprocal(void)
 {
+	BQSPC_TRACE_SCOPE(TraceReciprocal);
+
 	QSeries copy = *this;
 
 	/* If $1/(\sum_{n \geq 0} a_nq^n) = \sum_{n \geq 0} b_nq^n$, then we have
@@ -27,6 +37,8 @@ void QSeries::reciprocal(void)
  * the constant coefficient must equal 1 as the above function is called. */
 void QSeries::raiseToPower(int power)
 {
+	BQSPC_TRACE_SCOPE(TraceRaiseToPower);
+
 	if (power == 0) {
 		this->zero();
 		this->coefficients[0] = 1;
@@ -72,6 +84,8 @@ void QSeries::raiseToPower(int power)
 void QSeries::qPochhammer(int dilation1, int dilation2, bool negativePrefix,
 						  int subscript)
 {
+	BQSPC_TRACE_SCOPE(TraceQPochhammer);
+
 	QSeries shiftedCopy(this->limit);
 
 	/* We start by setting the result to one, and then repeatedly multiply by
@@ -112,30 +126,130 @@ void QSeries::qPochhammer(int dilation1, int dilation2, bool negativePrefix,
 	}
 }
 
-/* The truncated $q$-binomial coefficient. Both top and bottom must be
- * non-negative. If top is smaller than, bottom the result is zero, and is
- * otherwise computed as $(q;q_{top}/((q;q)_{bottom}(q;q)_{top - bottom})$.*/
-void QSeries::qBinomial(int top, int bottom)
+/* Multiplies the truncated $q$-series in place by $(1 \pm q^{shift})^{power}$,
+ * where $\pm$ is positive when the value of negativePrefix is set to true.
+ * Each call takes time linear in the number of coefficients times the
+ * magnitude of power, unlike building the factor and multiplying by it. For
+ * negative powers, the shift must be positive. */
+void QSeries::applyFactor(int shift, bool negativePrefix, int power)
+{
+	long sign = negativePrefix ? 1 : -1;
+
+	if (power == 0 || shift >= this->limit) return;
+
+	/* Past this power the binomial coefficients no longer fit in a long,
+	 * so the factor is applied once per power instead, which only adds and
+	 * stays exact modulo $2^{64}$ like the rest of the arithmetic. */
+	if (power > MaxWeightedPower) {
+		for (int pIndex = 0; pIndex < power; ++pIndex) {
+			this->applyFactor(shift, negativePrefix, 1);
+		}
+
+		return;
+	}
+
+	if (power > 0) {
+		long weights[MaxWeightedPower + 1];
+
+		/* Precompute the coefficients $\binom{power}{j}(\pm 1)^j$ of the
+		 * binomial expansion of the factor. */
+		weights[0] = 1;
+
+		for (int jIndex = 1; jIndex <= power; ++jIndex) {
+			weights[jIndex] = weights[jIndex - 1] * sign
+							* (power - jIndex + 1) / jIndex;
+		}
+
+		/* A factor of $1 \pm 1$ simply scales every coefficient. */
+		if (shift == 0) {
+			long scale = 0;
+
+			for (int jIndex = 0; jIndex <= power; ++jIndex) {
+				scale += weights[jIndex];
+			}
+
+			for (int index = 0; index < this->limit; ++index) {
+				this->coefficients[index] *= scale;
+			}
+
+			return;
+		}
+
+		/* Walking downwards lets the update happen in place, since every
+		 * coefficient read below nIndex is still the original one. */
+		for (int nIndex = this->limit - 1; nIndex >= shift; --nIndex) {
+			long value = this->coefficients[nIndex];
+
+			for (int jIndex = 1; jIndex <= power
+				 && jIndex * shift <= nIndex; ++jIndex) {
+
+				value += weights[jIndex]
+					   * this->coefficients[nIndex - jIndex * shift];
+			}
+
+			this->coefficients[nIndex] = value;
+		}
+
+		return;
+	}
+
+	/* Dividing by $1 \pm q^{shift}$ is the prefix recurrence
+	 * $b_n = a_n \mp b_{n - shift}$, which is repeated once for each
+	 * factor in the denominator. */
+	for (int pIndex = 0; pIndex < -power; ++pIndex) {
+		for (int nIndex = shift; nIndex < this->limit; ++nIndex) {
+			this->coefficients[nIndex] -= sign
+										* this->coefficients[nIndex - shift];
+		}
+	}
+}
+
+/* Multiplies the truncated $q$-series in place by the finite $q$-Pochhammer
+ * symbol $(\pm q^{dilation1}; q^{dilation2})_{subscript}^{power}$, applying
+ * it one factor at a time. */
+void QSeries::applyQPochhammer(int dilation1, int dilation2,
+							   bool negativePrefix, int subscript, int power)
+{
+	BQSPC_TRACE_SCOPE(TraceApplyQPochhammer);
+
+	for (int nIndex = 0; nIndex < subscript; ++nIndex) {
+		int shift = dilation1 + nIndex * dilation2;
+
+		/* As in qPochhammer, the remaining factors are all truncated. */
+		if (shift >= this->limit) break;
+
+		this->applyFactor(shift, negativePrefix, power);
+	}
+}
+
+/* Multiplies the truncated $q$-series in place by the $q$-binomial
+ * coefficient ${top \brack bottom}_{q^{dilation}}$, which is zero if bottom
+ * is larger than top. Both top and bottom must be non-negative, and the
+ * coefficient is taken from the table of the calling thread. */
+void QSeries::applyQBinomial(int top, int bottom, int dilation)
 {
 	if (bottom > top) {
 		this->zero();
-	} else if (bottom == top || bottom == 0) {
-		this->zero();
-		this->coefficients[0] = 1;
-	} else {
-		int bigSubscript;
-		QSeries divisor(this->limit);
-
-		/* Find out which subscript on the denominator is the biggest. The
-		 * associated $q$-Pochhammer symbol will be cancelled from the
-		 * numerator to start with. */
-		bigSubscript = (bottom > top - bottom) ? bottom : top - bottom;
-		this->qPochhammer(bigSubscript + 1, 1, true, top - bigSubscript);
-
-		/* Perform division by multiplying by the reciprocal. */
-		divisor.qPochhammer(1, 1, true, top - bigSubscript);
-		divisor.reciprocal();
-		*this *= divisor;
+		return;
+	}
+
+	const std::vector<long>& factor = QBinomialTable::local(this->limit)
+									  .entry(top, bottom);
+	int length = static_cast<int>(factor.size());
+
+	/* As in applyFactor, walking downwards lets the product be formed in
+	 * place. The constant coefficient of the factor is 1. */
+	for (int nIndex = this->limit - 1; nIndex >= dilation; --nIndex) {
+		long value = this->coefficients[nIndex];
+
+		for (int jIndex = 1; jIndex < length
+			 && jIndex * dilation <= nIndex; ++jIndex) {
+
+			value += factor[jIndex]
+				   * this->coefficients[nIndex - jIndex * dilation];
+		}
+
+		this->coefficients[nIndex] = value;
 	}
 }
 
@@ -144,12 +258,13 @@ void QSeries::qBinomial(int top, int bottom)
  * shift by $q^{c(n_0, \dots, n_\ell)}$. */
 void QSeries::qSeriesTerm(Parameters& parameters, int (&indices)[MaxIndices])
 {	
+	BQSPC_TRACE_SCOPE(TraceQSeriesTerm);
+
 	this->zero();
 	this->coefficients[0] = 1;
 
 	/* Multiply the term by all the $q$-Pochhammer symbols. */
 	for (int qPSIndex = 0; qPSIndex < parameters.qPSInUse; ++qPSIndex) {
-		QSeries factor(this->limit);
 		int subscript = 0;
 
 		/* Compute $s_i(n_0, \dots, n_\ell)$. */
@@ -158,12 +273,16 @@ void QSeries::qSeriesTerm(Parameters& parameters, int (&indices)[MaxIndices])
 					   * indices[index];
 		}
 
-		factor.qPochhammer(parameters.qPS[qPSIndex].dilation1,
-						   parameters.qPS[qPSIndex].dilation2,
-						   parameters.qPS[qPSIndex].negativePrefix,
-						   subscript);
-		factor.raiseToPower(parameters.qPS[qPSIndex].power);
-		*this *= factor;
+		this->applyQPochhammer(parameters.qPS[qPSIndex].dilation1,
+							   parameters.qPS[qPSIndex].dilation2,
+							   parameters.qPS[qPSIndex].negativePrefix,
+							   subscript, parameters.qPS[qPSIndex].power);
+	}
+
+	/* Parameters with one index have no $q$-binomial factor to apply. */
+	if (parameters.qBinomialDilation > 0 && parameters.indicesInUse > 1) {
+		this->applyQBinomial(indices[0], indices[1],
+							 parameters.qBinomialDilation);
 	}
 
 	if (parameters.alternatingSign) {
@@ -213,10 +332,29 @@ int QSeries::qSeriesPower(Parameters& parameters, int (&indices)[MaxIndices])
 	return power;
 }
 
+/* Returns the greatest common divisor of the powers of $q$ with nonzero
+ * coefficients, leaving out the constant term, or 0 if there are none. */
+long QSeries::supportGCD(void)
+{
+	long gcd = 0;
+
+	for (int index = 1; index < this->limit && gcd != 1; ++index) {
+		if (this->coefficients[index] != 0) {
+			gcd = std::gcd(gcd, static_cast<long>(index));
+		}
+	}
+
+	return gcd;
+}
+
 /* Computes the truncated $q$-series coefficients determined by the given
- * parameters. */
-void QSeries::qSeries(Parameters& parameters)
+ * parameters, keeping only the terms where $n_0$ leaves the remainder part
+ * when divided by parts. Adding up the series for every part gives the
+ * whole $q$-series. */
+void QSeries::qSeries(Parameters& parameters, int part, int parts)
 {
+	BQSPC_TRACE_SCOPE(TraceQSeries);
+
 	int indices[MaxIndices];
 	int index;
 
@@ -229,7 +367,7 @@ void QSeries::qSeries(Parameters& parameters)
 	/* The term given by the indices all equaling zero is identically 1 for
 	 * any combination of parameters. */
 	this->zero();
-	this->coefficients[0] = 1;
+	this->coefficients[0] = part == 0;
 
 	/* Iterate through the other possible combinations of indices. */
 	for (;;) {
@@ -238,7 +376,7 @@ void QSeries::qSeries(Parameters& parameters)
 		for (index = 0; index < parameters.indicesInUse; ++index) {
 			++indices[index];
 
-			if (indices[index] < MaxSeriesLimit) {
+			if (indices[index] < this->limit) {
 				break;
 			}
 
@@ -250,20 +388,253 @@ void QSeries::qSeries(Parameters& parameters)
 			return;
 		}
 
+		if (indices[0] % parts != part) continue;
+
 		power = this->qSeriesPower(parameters, indices);
 
 		/* Compute the term and add the contribution if there are any
-		 * coefficients that will not be truncated. */
+		 * coefficients that will not be truncated. The shift by $q^{power}$
+		 * is done while adding to avoid copying the term around. */
 		if (power < this->limit) {
 			QSeries term(this->limit - power);
 
 			term.qSeriesTerm(parameters, indices);
-			term.limit = this->limit;
-			term.translate(power);
-			*this += term;
+
+			for (int kIndex = 0; kIndex < term.limit; ++kIndex) {
+				this->coefficients[kIndex + power] += term.coefficients[kIndex];
+			}
 		}
 	}
 }
 
+/* The same as qSeriesPower, for exactly Indices summation indices. */
+template<int Indices>
+int QSeries::qSeriesPowerShape(Parameters& parameters,
+							   int (&indices)[MaxIndices])
+{
+	int power = 0;
+
+	for (int nIndex = 0; nIndex < Indices; ++nIndex) {
+		power += parameters.qScalarsDegree1[nIndex] * indices[nIndex]
+			   + parameters.qScalarsDegree2Pure[nIndex]
+			   * indices[nIndex] * indices[nIndex];
+
+		for (int kIndex = nIndex + 1; kIndex < Indices; ++kIndex) {
+			int mIndex = nIndex * (Indices - 1)
+					   - nIndex * (nIndex + 1) / 2 + kIndex - 1;
+
+			power += parameters.qScalarsDegree2Mixed[mIndex]
+				   * indices[nIndex] * indices[kIndex];
+		}
+	}
+
+	if (parameters.dividePowerBy2) {
+		power /= 2;
+	}
+
+	return power;
+}
+
+/* Adds to the $q$-series every term of the sum over $n_{Depth}, \dots,
+ * n_\ell$, with the outer indices fixed to their values in indices and the
+ * later entries of indices equal to zero. This sums the innermost index
+ * first. On entry, running must hold the product of the $q$-Pochhammer
+ * symbols at those indices, and subscripts the values of $s_i$ there. Both
+ * are updated in place as $n_{Depth}$ grows, so each step only applies the
+ * few factors by which a symbol grows, and everything depending on the
+ * outer indices alone is shared by the whole inner sum. The $q$-binomial
+ * factor, if QBinomial is set, is kept in running the same way. Unless
+ * cache is nullptr, products it keeps are read back instead of applying
+ * the factors, and the ones computed are kept in it. The value of parity is
+ * the sum of the outer indices modulo 2. At depth 0, only the terms where
+ * $n_0$ leaves the remainder part when divided by parts are added, though
+ * running still steps through every $n_0$. */
+template<int Indices, int QPS, bool QBinomial, int Limit, int Depth>
+void QSeries::qSeriesNested(Parameters& parameters,
+							int (&indices)[MaxIndices],
+							int (&subscripts)[MaxQPS],
+							QSeries& running, TermCache *cache,
+							int parity, int part, int parts)
+{
+	int power = this->qSeriesPowerShape<Indices>(parameters, indices);
+
+	/* Every coefficient of $c$ is non-negative, so $c$ is weakly increasing
+	 * in each index. Once a term is truncated entirely, so is every term
+	 * that follows it in this sum and in all the sums nested inside it. */
+	while (power < Limit) {
+		running.limit = Limit - power;
+
+		if (Depth > 0 || indices[0] % parts == part) {
+			if constexpr (Depth + 1 < Indices) {
+				QSeries inner(running.limit);
+				int innerSubscripts[MaxQPS];
+
+				for (int index = 0; index < inner.limit; ++index) {
+					inner.coefficients[index]
+						= running.coefficients[index];
+				}
+
+				for (int qPSIndex = 0; qPSIndex < QPS; ++qPSIndex) {
+					innerSubscripts[qPSIndex] = subscripts[qPSIndex];
+				}
+
+				this->qSeriesNested<Indices, QPS, QBinomial, Limit,
+									Depth + 1>(parameters, indices,
+											   innerSubscripts, inner, cache,
+											   parity, 0, 1);
+			} else {
+				long sign = (parameters.alternatingSign && parity) ? -1 : 1;
+
+				for (int index = 0; index < running.limit; ++index) {
+					this->coefficients[index + power]
+						+= sign * running.coefficients[index];
+				}
+			}
+		}
+
+		/* The same bound on the number of terms as in qSeries. */
+		if (++indices[Depth] == Limit) break;
+
+		/* Past $n_1 = n_0$ the $q$-binomial factor and every later term of
+		 * this sum vanish. */
+		if constexpr (QBinomial && Depth == 1) {
+			if (indices[1] > indices[0]) break;
+		}
+
+		power = this->qSeriesPowerShape<Indices>(parameters, indices);
+
+		if (power >= Limit) break;
+
+		running.limit = Limit - power;
+		parity ^= 1;
+
+		const long *kept = cache == nullptr ? nullptr
+						 : cache->find(indices, running.limit);
+
+		/* A product kept by an earlier job with the same symbols only has
+		 * to be copied, as long as enough of it was kept. */
+		if (kept != nullptr) {
+			for (int index = 0; index < running.limit; ++index) {
+				running.coefficients[index] = kept[index];
+			}
+
+			for (int qPSIndex = 0; qPSIndex < QPS; ++qPSIndex) {
+				subscripts[qPSIndex] += parameters.qPS[qPSIndex]
+										.subScalars[Depth];
+			}
+
+			continue;
+		}
+
+		/* Multiply in the factors by which each $q$-Pochhammer symbol grows
+		 * when $n_{Depth}$ increases by one. */
+		for (int qPSIndex = 0; qPSIndex < QPS; ++qPSIndex) {
+			for (int step = 0; step < parameters.qPS[qPSIndex]
+				 .subScalars[Depth]; ++step) {
+
+				running.applyFactor(parameters.qPS[qPSIndex].dilation1
+								  + subscripts[qPSIndex]
+								  * parameters.qPS[qPSIndex].dilation2,
+									parameters.qPS[qPSIndex].negativePrefix,
+									parameters.qPS[qPSIndex].power);
+				++subscripts[qPSIndex];
+			}
+		}
+
+		/* Stepping $n_1$ up to $k$ multiplies ${n_0 \brack n_1}_q$ by
+		 * $(1-q^{n_0-k+1})/(1-q^k)$, in $q^e$ for the dilation $e$. */
+		if constexpr (QBinomial && Depth == 1) {
+			int dilation = parameters.qBinomialDilation;
+
+			running.applyFactor(dilation * (indices[0] - indices[1] + 1),
+								false, 1);
+			running.applyFactor(dilation * indices[1], false, -1);
+		}
+
+		if (cache != nullptr) {
+			cache->insert(indices, running);
+		}
+	}
+
+	indices[Depth] = 0;
+}
+
+/* The same as qSeries, for the shape and limit given by the template
+ * arguments, but evaluated as nested partial sums by qSeriesNested, with
+ * the products kept by the term cache of the calling thread. The series
+ * must already have its limit set to Limit. */
+template<int Indices, int QPS, bool QBinomial, int Limit>
+void QSeries::qSeriesShape(Parameters& parameters, int part, int parts)
+{
+	BQSPC_TRACE_SCOPE(TraceQSeriesShape);
+
+	int indices[MaxIndices];
+	int subscripts[MaxQPS];
+	QSeries running(Limit);
+
+	for (int index = 0; index < Indices; ++index) {
+		indices[index] = 0;
+	}
+
+	for (int qPSIndex = 0; qPSIndex < QPS; ++qPSIndex) {
+		subscripts[qPSIndex] = 0;
+	}
+
+	/* With every index zero, each $q$-Pochhammer symbol is empty. */
+	running.zero();
+	running.coefficients[0] = 1;
+
+	/* Only the products for the search limit are kept, so that verifying
+	 * an identity does not throw away those of the jobs around it. Nor are
+	 * they kept for a part of a shared evaluation, since the threads
+	 * helping with it would throw away those of their own jobs. */
+	TermCache *cache = Limit == MaxSeriesLimit && parts == 1
+					 ? TermCache::local(parameters) : nullptr;
+
+	this->zero();
+	this->qSeriesNested<Indices, QPS, QBinomial, Limit, 0>(
+		parameters, indices, subscripts, running, cache, 0, part, parts);
+}
+
+/* Selects the method to compute the $q$-series for the given parameters up
+ * to the given limit, which is a specialized kernel whenever one exists and
+ * qSeries otherwise. This is meant to be called once per parameter
+ * combination, with the result applied to a series with that limit. */
+QSeries::Kernel QSeries::kernel(Parameters& parameters, int limit)
+{
+	int shape = parameters.shape();
+
+	/* The tables of kernels for the search limit and for the verification
+	 * limit, where the kernel for each shape is at the index of the shape. */
+	static constexpr auto tables = []<int... Shapes>(
+		std::integer_sequence<int, Shapes...>) {
+
+		return std::array<std::array<Kernel, ShapeCount>, 2>{{
+			{&QSeries::qSeriesShape<Parameters::shapeIndices(Shapes),
+									Parameters::shapeQPS(Shapes),
+									Parameters::shapeQBinomial(Shapes),
+									MaxSeriesLimit>...},
+			{&QSeries::qSeriesShape<Parameters::shapeIndices(Shapes),
+									Parameters::shapeQPS(Shapes),
+									Parameters::shapeQBinomial(Shapes),
+									MaxVerificationLimit>...}}};
+	}(std::make_integer_sequence<int, ShapeCount>());
+
+	if (parameters.indicesInUse < 1 || parameters.indicesInUse > MaxIndices
+		|| parameters.qPSInUse < 0 || parameters.qPSInUse > MaxQPS) {
+		return &QSeries::qSeries;
+	}
+
+	if (limit == MaxSeriesLimit) {
+		return tables[0][shape];
+	}
+
+	if (limit == MaxVerificationLimit) {
+		return tables[1][shape];
+	}
+
+	return &QSeries::qSeries;
+}
+
 };
 
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* The number of standard errors on either side of an estimate that make up
+ * its 95% confidence interval. */
+const static double ConfidenceScale = 1.96;
+
+/* Gives out the next sampled runs, as many whole runs as fit in the count
+ * but at least one, so that a run is tried by a single worker. */
+int Sampler::populate(std::deque<Parameters>& queue, int count)
+{
+	int length = 0;
+
+	while (this->givenRuns < this->lengths.size()
+		   && (length == 0
+			   || length + this->lengths[this->givenRuns] <= count)) {
+
+		for (long index = 0; index < this->lengths[this->givenRuns];
+			 ++index) {
+
+			queue.push_back(this->jobs[this->given++]);
+			++length;
+		}
+
+		++this->givenRuns;
+	}
+
+	return length;
+}
+
+/* The shape of the next sampled combination, or -1 once all are given. */
+int Sampler::nextShape(void)
+{
+	if (this->given == this->jobs.size()) return -1;
+
+	return this->jobs[this->given].shape();
+}
+
+/* Adds the outcome to the results of its run and its shape. */
+void Sampler::finish(WorkerThread&, Parameters& parameters,
+					 ProductSignature&, bool identity, long nanoseconds)
+{
+	int shape = parameters.shape();
+	std::scoped_lock<std::mutex> lock(this->resultsLock);
+	Run& run = std::prev(this->runs.upper_bound(
+				   this->generator.position(parameters)))->second;
+
+	run.tried++;
+	run.hits += identity;
+	run.nanoseconds += nanoseconds;
+	this->tried[shape]++;
+	this->hits[shape] += identity;
+	this->nanoseconds[shape] += nanoseconds;
+}
+
+/* Samples the combinations within the given bounds, leaving out those the
+ * excluded generator gives out, or none if it is nullptr. */
+void Sampler::bound(const SearchBounds& bounds, ParameterGenerator *excluded)
+{
+	this->generator = ParameterGenerator(bounds);
+	this->excluded = excluded;
+}
+
+/* Samples up to about the given number of combinations of each shape, in
+ * whole runs, tries them on one worker thread per hardware thread so that
+ * each one is timed running alone on its core, and writes the estimates to
+ * stdout. */
+void Sampler::run(long perShape, Catalog *catalog, SeriesStore *store,
+				  ProductIndex *index)
+{
+	std::mt19937_64 random(SamplingSeed);
+	int threadCount = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<long> starts;
+	long sizes[ShapeCount];
+	long sampled[ShapeCount];
+	long kept[ShapeCount];
+
+	/* Draw distinct runs within each shape using Floyd's algorithm, which
+	 * takes one random number per run drawn. */
+	for (int shape = 0; shape < ShapeCount; ++shape) {
+		long size = this->generator.shapeSize(shape);
+		long start = this->generator.shapeStart(shape);
+		long runCount = (size + SampledRunLength - 1) / SampledRunLength;
+		long count = std::min(runCount, (perShape + SampledRunLength - 1)
+										/ SampledRunLength);
+		std::unordered_set<long> drawn;
+
+		for (long run = runCount - count; run < runCount; ++run) {
+			long drawnRun = std::uniform_int_distribution<long>(
+							0, run)(random);
+
+			if (!drawn.insert(drawnRun).second) {
+				drawn.insert(run);
+			}
+		}
+
+		sizes[shape] = size;
+		sampled[shape] = 0;
+		kept[shape] = 0;
+
+		for (long run : drawn) {
+			starts.push_back(start + run * SampledRunLength);
+			this->runs[starts.back()] = {shape, 0, 0, 0};
+		}
+	}
+
+	/* Mixing the runs of the shapes lets the scheduler size batches as it
+	 * goes, while the combinations of a run stay together. */
+	std::shuffle(starts.begin(), starts.end(), random);
+
+	for (long start : starts) {
+		int shape = this->runs[start].shape;
+		long length = std::min(static_cast<long>(SampledRunLength),
+							   this->generator.shapeStart(shape)
+							   + sizes[shape] - start);
+		std::deque<Parameters> run;
+
+		this->generator.seek(start);
+		this->generator.populate(run, length);
+		sampled[shape] += length;
+		this->lengths.push_back(0);
+
+		for (Parameters& parameters : run) {
+			if (this->excluded == nullptr
+				|| !this->excluded->gives(parameters)) {
+
+				this->jobs.push_back(parameters);
+				this->lengths.back()++;
+				kept[shape]++;
+			}
+		}
+
+		if (this->lengths.back() == 0) this->lengths.pop_back();
+	}
+
+	/* The number of combinations of each shape left after the exclusion
+	 * is estimated from the fraction of those sampled that are kept. */
+	for (int shape = 0; shape < ShapeCount; ++shape) {
+		if (kept[shape] < sampled[shape]) {
+			sizes[shape] = std::llround(static_cast<double>(sizes[shape])
+										* kept[shape] / sampled[shape]);
+		}
+	}
+
+	Scheduler scheduler(this);
+
+	scheduler.run(catalog, store, index, threadCount);
+
+	double seconds = 0;
+	double secondsVariance = 0;
+	double identities = 0;
+	double identitiesVariance = 0;
+	long combinations = 0;
+	long runCounts[ShapeCount] = {};
+	double timeSquares[ShapeCount] = {};
+	double hitSquares[ShapeCount] = {};
+
+	/* The combinations of a run are not independent of one another, so the
+	 * spread of the estimates is measured between whole runs, from how far
+	 * each run is from the mean of its shape. */
+	for (auto& [start, run] : this->runs) {
+		int shape = run.shape;
+		double mean;
+		double rate;
+
+		if (run.tried == 0) continue;
+
+		mean = this->nanoseconds[shape] / this->tried[shape];
+		rate = static_cast<double>(this->hits[shape]) / this->tried[shape];
+		runCounts[shape]++;
+		timeSquares[shape] += std::pow(run.nanoseconds - run.tried * mean, 2);
+		hitSquares[shape] += std::pow(run.hits - run.tried * rate, 2);
+	}
+
+	std::cout << "# indices qps binomial combinations sampled "
+				 "nanoseconds/candidate +/- hits/candidate +/-\n"
+			  << std::fixed;
+
+	for (int shape = 0; shape < ShapeCount; ++shape) {
+		long size = sizes[shape];
+		long count = this->tried[shape];
+		long runCount = runCounts[shape];
+
+		if (size == 0 || count == 0) continue;
+
+		/* Sampling without replacement shrinks the variance of the means by
+		 * the fraction of the shape left untried. Each mean is a ratio of
+		 * sums over the runs, whose variance follows from the spread of the
+		 * runs about it. */
+		double correction = std::max(1 - static_cast<double>(count) / size,
+									 0.0);
+		double scale = runCount > 1 ? static_cast<double>(runCount)
+					 / (runCount - 1) / count / count * correction : 0;
+		double mean = this->nanoseconds[shape] / count;
+		double rate = static_cast<double>(this->hits[shape]) / count;
+		double meanInterval = ConfidenceScale * std::sqrt(
+							  timeSquares[shape] * scale);
+		double rateInterval = ConfidenceScale * std::sqrt(
+							  hitSquares[shape] * scale);
+
+		/* No hits at all still leaves room for some, which the rule of
+		 * three bounds. */
+		if (this->hits[shape] == 0 && correction > 0) {
+			rateInterval = 3.0 / count;
+		}
+
+		combinations += size;
+		seconds += size * mean / 1e9;
+		secondsVariance += std::pow(size * meanInterval / 1e9
+									/ ConfidenceScale, 2);
+		identities += size * rate;
+		identitiesVariance += std::pow(size * rateInterval
+									   / ConfidenceScale, 2);
+
+		std::cout << Parameters::shapeIndices(shape) << ' '
+				  << Parameters::shapeQPS(shape) << ' '
+				  << Parameters::shapeQBinomial(shape) << ' ' << size << ' '
+				  << count << std::setprecision(1)
+				  << ' ' << mean << ' ' << meanInterval
+				  << std::setprecision(6) << ' ' << rate << ' '
+				  << rateInterval << '\n';
+	}
+
+	std::cout << std::setprecision(1)
+			  << "# " << combinations << " combinations in total\n"
+			  << "# " << seconds << " +/- "
+			  << ConfidenceScale * std::sqrt(secondsVariance)
+			  << " thread seconds, or " << seconds / WorkerThreadsToUse
+			  << " +/- " << ConfidenceScale * std::sqrt(secondsVariance)
+						  / WorkerThreadsToUse << " seconds on "
+			  << WorkerThreadsToUse << " threads with a core each\n"
+			  << "# " << identities << " +/- "
+			  << ConfidenceScale * std::sqrt(identitiesVariance)
+			  << " identities\n";
+}
+
+};
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Adds a worker thread to those taking jobs. Every worker must be enrolled
+ * before any of them starts. */
+void Scheduler::enroll(WorkerThread *worker)
+{
+	this->workers.push_back(worker);
+}
+
+/* Tries every job from the source on the given number of new worker
+ * threads, and returns once they have all finished, adding up the
+ * candidates they rejected. */
+void Scheduler::run(Catalog *catalog, SeriesStore *store,
+					ProductIndex *products, int threadCount)
+{
+	std::vector<std::thread> threads;
+
+	this->idle = 0;
+	this->exhausted = 0;
+
+	/* Create the worker threads, all enrolled before any of them starts. */
+	for (int index = 0; index < threadCount; ++index) {
+		this->enroll(new WorkerThread(this, catalog, store, products));
+	}
+
+	for (WorkerThread *worker : this->workers) {
+		threads.emplace_back(&WorkerThread::jobLoop, worker);
+	}
+
+	for (int index = 0; index < threadCount; ++index) {
+		threads[index].join();
+
+		for (int reason = 0; reason < RejectionReasons; ++reason) {
+			this->rejections[reason] += this->workers[index]->rejections[reason];
+		}
+
+		delete this->workers[index];
+	}
+
+	this->workers.clear();
+}
+
+/* Returns the estimated time in nanoseconds to try parameters of the same
+ * shape as the given ones, or 0 if there is no estimate yet. */
+long Scheduler::estimate(Parameters& parameters)
+{
+	return this->costs[parameters.shape()].load(std::memory_order_relaxed);
+}
+
+/* Moves the estimated cost toward a new sample of the given number of
+ * nanoseconds. Concurrent updates may overwrite each other, which only
+ * loses a sample. */
+static void updateCost(std::atomic<long>& cost, long nanoseconds)
+{
+	long average = cost.load(std::memory_order_relaxed);
+
+	/* An exponential moving average, following changes within the shape as
+	 * the generator moves through it. */
+	if (average == 0) {
+		average = nanoseconds;
+	} else {
+		average += (nanoseconds - average) / 16;
+	}
+
+	cost.store(std::max(average, 1L), std::memory_order_relaxed);
+}
+
+/* Updates the estimated cost of the shape of the parameters after they took
+ * the given number of nanoseconds to try. */
+void Scheduler::record(Parameters& parameters, long nanoseconds)
+{
+	updateCost(this->costs[parameters.shape()], nanoseconds);
+}
+
+/* Moves a batch of jobs from the source into the queue of the worker, sized
+ * so it takes about TargetBatchNanoseconds by the current estimate for the
+ * next shape. Until a shape has been timed, or if the source cannot tell the
+ * next shape, jobs are handed out one at a time. While another worker is
+ * asking the source for jobs, this waits for it, but returns early if an
+ * evaluation is shared meanwhile so the worker can help with it first.
+ * Returns false once the source is exhausted. */
+bool Scheduler::refill(WorkerThread& worker)
+{
+	std::deque<Parameters> batch;
+	int length = 1;
+	int shape;
+	bool populated;
+
+	{
+		std::unique_lock<std::mutex> lock(this->helpLock);
+
+		++this->idle;
+		this->helpWanted.wait(lock, [this] {
+			return !this->sourceBusy || !this->shared.empty();
+		});
+		--this->idle;
+
+		if (!this->shared.empty()) return true;
+
+		this->sourceBusy = true;
+	}
+
+	shape = this->source->nextShape();
+
+	if (shape >= 0) {
+		long cost = this->costs[shape].load(std::memory_order_relaxed);
+
+		if (cost > 0) {
+			length = std::clamp(TargetBatchNanoseconds / cost, 1L,
+								static_cast<long>(JobQueueLimit));
+		}
+	}
+
+	populated = this->source->populate(batch, length) > 0;
+
+	{
+		std::scoped_lock<std::mutex> lock(this->helpLock);
+
+		this->sourceBusy = false;
+	}
+
+	this->helpWanted.notify_all();
+
+	if (!populated) return false;
+
+	std::scoped_lock<std::mutex> lock(worker.jobQueueLock);
+
+	for (Parameters& parameters : batch) {
+		worker.jobQueue.push_back(parameters);
+	}
+
+	return true;
+}
+
+/* Moves half of the jobs, rounded up, from the back of the queue of the
+ * first other worker found with any left into the queue of the given one.
+ * Returns false if every other queue was empty. */
+bool Scheduler::steal(WorkerThread& thief)
+{
+	int start = 0;
+	int count = this->workers.size();
+
+	while (start < count && this->workers[start] != &thief) {
+		++start;
+	}
+
+	/* Start with the next worker, so thieves spread over their victims. */
+	for (int offset = 1; offset < count; ++offset) {
+		WorkerThread *victim = this->workers[(start + offset) % count];
+		std::deque<Parameters> loot;
+
+		{
+			std::scoped_lock<std::mutex> lock(victim->jobQueueLock);
+			int length = (victim->jobQueue.size() + 1) / 2;
+
+			for (int index = 0; index < length; ++index) {
+				loot.push_front(victim->jobQueue.back());
+				victim->jobQueue.pop_back();
+			}
+		}
+
+		if (loot.empty()) continue;
+
+		std::scoped_lock<std::mutex> lock(thief.jobQueueLock);
+
+		for (Parameters& parameters : loot) {
+			thief.jobQueue.push_back(parameters);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+/* Takes the next job already in the queue of the worker, without refilling
+ * or stealing. Returns false if the queue is empty. */
+bool Scheduler::nextQueued(WorkerThread& worker, Parameters& parameters)
+{
+	std::scoped_lock<std::mutex> lock(worker.jobQueueLock);
+
+	if (worker.jobQueue.empty()) return false;
+
+	parameters = worker.jobQueue.front();
+	worker.jobQueue.pop_front();
+	return true;
+}
+
+/* Chooses how many parts to split the evaluation of the $q$-series of the
+ * parameters up to the given limit into. That is one, unless it is expected
+ * to take more than SplitNanoseconds and other workers are idle, in which
+ * case there is a part for each of them as well. Evaluations up to
+ * MaxVerificationLimit are expected to take that long until one of the same
+ * shape has been timed. */
+int Scheduler::parts(Parameters& parameters, int limit)
+{
+	long cost;
+
+	if (limit == MaxSeriesLimit) {
+		cost = this->seriesCosts[0][parameters.shape()].load(
+			   std::memory_order_relaxed);
+	} else if (limit == MaxVerificationLimit) {
+		cost = this->seriesCosts[1][parameters.shape()].load(
+			   std::memory_order_relaxed);
+
+		if (cost == 0) cost = SplitNanoseconds;
+	} else {
+		return 1;
+	}
+
+	if (cost < SplitNanoseconds) return 1;
+
+	std::scoped_lock<std::mutex> lock(this->helpLock);
+
+	return this->idle + 1;
+}
+
+/* Claims the next part of the given shared evaluation, or of the first one
+ * shared if none is given, and computes it. Returns false if there was no
+ * part left to claim. */
+bool Scheduler::work(SharedEvaluation *evaluation)
+{
+	int part;
+
+	{
+		std::scoped_lock<std::mutex> lock(this->helpLock);
+
+		if (evaluation == nullptr) {
+			if (this->shared.empty()) return false;
+
+			evaluation = this->shared.front();
+		}
+
+		if (evaluation->claimed == evaluation->parts) return false;
+
+		part = evaluation->claimed++;
+
+		/* Nobody else needs to find it once every part is claimed. */
+		if (evaluation->claimed == evaluation->parts) {
+			std::erase(this->shared, evaluation);
+		}
+	}
+
+	(evaluation->partials[part].*evaluation->kernel)(evaluation->parameters,
+													 part,
+													 evaluation->parts);
+
+	/* The evaluation may be gone as soon as the lock is released. */
+	std::scoped_lock<std::mutex> lock(this->helpLock);
+
+	++evaluation->finished;
+	this->partsDone.notify_all();
+	return true;
+}
+
+/* Evaluates the $q$-series of the parameters up to the limit of the series.
+ * An evaluation worth splitting is shared in parts with idle workers, and
+ * the calling worker computes parts too until none are left to claim, then
+ * waits for the rest and adds up the partial series. Only evaluations done
+ * in one part are timed, so the estimate stays that of a single worker. */
+void Scheduler::evaluate(Parameters& parameters, QSeries& series)
+{
+	QSeries::Kernel kernel = QSeries::kernel(parameters, series.limit);
+	int parts = this->parts(parameters, series.limit);
+	auto start = std::chrono::steady_clock::now();
+
+	if (parts > 1) {
+		SharedEvaluation evaluation;
+
+		evaluation.parameters = parameters;
+		evaluation.kernel = kernel;
+		evaluation.parts = parts;
+		evaluation.claimed = 0;
+		evaluation.finished = 0;
+		evaluation.partials.assign(parts, QSeries(series.limit));
+
+		{
+			std::scoped_lock<std::mutex> lock(this->helpLock);
+
+			this->shared.push_back(&evaluation);
+		}
+
+		this->helpWanted.notify_all();
+
+		while (this->work(&evaluation)) {}
+
+		{
+			std::unique_lock<std::mutex> lock(this->helpLock);
+
+			this->partsDone.wait(lock, [&evaluation] {
+				return evaluation.finished == evaluation.parts;
+			});
+		}
+
+		series.zero();
+
+		for (QSeries& partial : evaluation.partials) {
+			for (int index = 0; index < series.limit; ++index) {
+				series.coefficients[index] += partial.coefficients[index];
+			}
+		}
+
+		return;
+	}
+
+	(series.*kernel)(parameters, 0, 1);
+
+	long nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					   std::chrono::steady_clock::now() - start).count();
+
+	if (series.limit == MaxSeriesLimit) {
+		updateCost(this->seriesCosts[0][parameters.shape()], nanoseconds);
+	} else if (series.limit == MaxVerificationLimit) {
+		updateCost(this->seriesCosts[1][parameters.shape()], nanoseconds);
+	}
+}
+
+/* Waits, once the worker is out of jobs for good, until another worker
+ * shares an evaluation or every worker is out of jobs. Returns false in the
+ * latter case, when the worker should stop. */
+bool Scheduler::linger(void)
+{
+	std::unique_lock<std::mutex> lock(this->helpLock);
+	int workers = this->workers.size();
+
+	++this->exhausted;
+	++this->idle;
+	this->helpWanted.notify_all();
+	this->helpWanted.wait(lock, [this, workers] {
+		return !this->shared.empty() || this->exhausted == workers;
+	});
+	--this->idle;
+
+	if (this->exhausted == workers) return false;
+
+	--this->exhausted;
+	return true;
+}
+
+/* Takes the next job for the worker, refilling or stealing as needed, and
+ * helping with shared evaluations whenever there are any. Returns false
+ * once there is no work left anywhere. */
+bool Scheduler::next(WorkerThread& worker, Parameters& parameters)
+{
+	for (;;) {
+		if (this->nextQueued(worker, parameters)) return true;
+
+		if (this->work(nullptr)) continue;
+
+		if (this->refill(worker) || this->steal(worker)) continue;
+
+		if (!this->linger()) return false;
+	}
+}
+
+};
@@ -0,0 +1,122 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* The name of each bound, which is the name of its member, and the
+ * smallest value it may take. */
+struct SearchBound
+{
+	const char *name;
+	int SearchBounds::*member;
+	int minimum;
+};
+
+const static SearchBound SearchBoundList[] = {
+	{"Max_qScalarsDegree1", &SearchBounds::Max_qScalarsDegree1, 0},
+	{"Max_qScalarsDegree2Pure", &SearchBounds::Max_qScalarsDegree2Pure, 0},
+	{"Max_qScalarsDegree2Mixed", &SearchBounds::Max_qScalarsDegree2Mixed, 0},
+	{"Max_qPS_power", &SearchBounds::Max_qPS_power, 1},
+	{"Max_qPS_dilation1", &SearchBounds::Max_qPS_dilation1, 1},
+	{"Max_qPS_dilation2", &SearchBounds::Max_qPS_dilation2, 1},
+	{"Max_qPS_subScalars", &SearchBounds::Max_qPS_subScalars, 1},
+	{"Max_qBinomial_dilation", &SearchBounds::Max_qBinomial_dilation, 0},
+	{"Min_indicesInUse", &SearchBounds::Min_indicesInUse, 1},
+	{"Max_indicesInUse", &SearchBounds::Max_indicesInUse, 1},
+	{"Max_qPSInUse", &SearchBounds::Max_qPSInUse, 0},
+};
+
+/* Changes the bounds given in the text, which is a comma separated list of
+ * assignments such as Max_qPS_power=3, leaving the rest as they are.
+ * Returns false, leaving the bounds partly changed, if the text names a
+ * bound that does not exist or gives one a value out of its range, or if
+ * the combinations within the bounds are too many to number in a long. */
+bool SearchBounds::read(const char *text)
+{
+	std::string assignments(text);
+	std::size_t start = 0;
+
+	while (start <= assignments.size()) {
+		std::size_t end = assignments.find(',', start);
+		std::string assignment;
+		std::size_t equals;
+		bool found = false;
+
+		if (end == std::string::npos) end = assignments.size();
+
+		assignment = assignments.substr(start, end - start);
+		equals = assignment.find('=');
+		start = end + 1;
+
+		for (const SearchBound& bound : SearchBoundList) {
+			char *rest;
+			long value;
+
+			if (equals == std::string::npos
+				|| assignment.compare(0, equals, bound.name) != 0
+				|| std::strlen(bound.name) != equals) {
+
+				continue;
+			}
+
+			value = std::strtol(assignment.c_str() + equals + 1, &rest, 10);
+
+			if (*rest != '\0' || rest == assignment.c_str() + equals + 1
+				|| value < bound.minimum || value > MaxVerificationLimit) {
+
+				std::cerr << "The bound " << bound.name << " cannot be "
+						  << assignment.substr(equals + 1) << ".\n";
+				return false;
+			}
+
+			this->*bound.member = value;
+			found = true;
+		}
+
+		if (!found) {
+			std::cerr << "There is no bound to set in " << assignment
+					  << ".\n";
+			return false;
+		}
+	}
+
+	if (this->Min_indicesInUse > this->Max_indicesInUse
+		|| this->Max_indicesInUse > MaxIndices
+		|| this->Max_qPSInUse > MaxQPS) {
+
+		std::cerr << "The number of indices must be from 1 to " << MaxIndices
+				  << ", and the number of q-Pochhammer symbols at most "
+				  << MaxQPS << ".\n";
+		return false;
+	}
+
+	/* Positions in the order of the generator are kept in a long. */
+	if (ParameterGenerator(*this).combinations() < 0) {
+		std::cerr << "There are too many combinations within these bounds "
+					 "to number them.\n";
+		return false;
+	}
+
+	return true;
+}
+
+/* The bounds of the search this program was built for. */
+SearchBounds::SearchBounds(void)
+{
+	this->Max_qScalarsDegree1 = 2;
+	this->Max_qScalarsDegree2Pure = 2;
+	this->Max_qScalarsDegree2Mixed = 2;
+	this->Max_qPS_power = 2;
+	this->Max_qPS_dilation1 = 2;
+	this->Max_qPS_dilation2 = 2;
+	this->Max_qPS_subScalars = 2;
+	this->Max_qBinomial_dilation = 2;
+	this->Min_indicesInUse = 2;
+	this->Max_indicesInUse = 2;
+	this->Max_qPSInUse = 2;
+}
+
+};
@@ -0,0 +1,169 @@
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Every store starts with this header, which records the layout of the
+ * encoded parameters so that files from incompatible builds are refused,
+ * followed by StoreVersion and padding up to the alignment of records. */
+static const char StoreMagic[8] = {'b', 'q', 's', 'p', 'c', 's', 't', '3'};
+const static int StoreHeaderSize = 24;
+
+/* The version of the arithmetic the stored series were computed by. The
+ * key only encodes the parameters, so this must be raised whenever a change
+ * to the kernels or to what the parameters mean changes any series, and
+ * stores from before the change are then refused rather than trusted. */
+const static int StoreVersion = 1;
+
+/* Opens the store at the given path, creating it if needed, and indexes
+ * every complete record in it. A record cut short by an interrupted run is
+ * dropped. Returns false and prints the reason if the file cannot be used. */
+bool SeriesStore::open(const char *path)
+{
+	char header[StoreHeaderSize] = {};
+	int layout[2] = {MaxIndices, MaxQPS};
+	int version = StoreVersion;
+	struct stat status;
+	long offset;
+
+	std::memcpy(header, StoreMagic, sizeof(StoreMagic));
+	std::memcpy(header + sizeof(StoreMagic), layout, sizeof(layout));
+	std::memcpy(header + sizeof(StoreMagic) + sizeof(layout), &version,
+				sizeof(version));
+
+	this->file = ::open(path, O_RDWR | O_CREAT, 0644);
+
+	if (this->file < 0 || fstat(this->file, &status) != 0) {
+		std::cerr << "Cannot open the series store " << path << ".\n";
+		return false;
+	}
+
+	/* A new file only needs its header. */
+	if (status.st_size == 0) {
+		if (write(this->file, header, StoreHeaderSize) != StoreHeaderSize) {
+			std::cerr << "Cannot write to the series store " << path << ".\n";
+			return false;
+		}
+
+		return true;
+	}
+
+	this->mappingSize = status.st_size;
+	this->mapping = static_cast<const char *>(mmap(nullptr,
+					this->mappingSize, PROT_READ, MAP_SHARED, this->file, 0));
+
+	if (this->mapping == MAP_FAILED) {
+		this->mapping = nullptr;
+		std::cerr << "Cannot map the series store " << path << ".\n";
+		return false;
+	}
+
+	if (this->mappingSize < StoreHeaderSize
+		|| std::memcmp(this->mapping, header,
+					   sizeof(StoreMagic) + sizeof(layout)) != 0) {
+
+		std::cerr << path << " is not a series store for this build.\n";
+		return false;
+	}
+
+	if (std::memcmp(this->mapping, header, StoreHeaderSize) != 0) {
+		std::cerr << path << " holds series computed by another version of "
+				  "the arithmetic, and must be deleted.\n";
+		return false;
+	}
+
+	/* Index the records, keeping the first one stored for each key. */
+	for (offset = StoreHeaderSize; offset
+		 + static_cast<long>(sizeof(Record)) <= this->mappingSize;) {
+
+		const Record *record = reinterpret_cast<const Record *>(
+							   this->mapping + offset);
+		long size = sizeof(Record) + record->limit * sizeof(long);
+
+		if (record->limit < 1 || record->limit > MaxVerificationLimit
+			|| offset + size > this->mappingSize) {
+			break;
+		}
+
+		std::vector<int> key(record->key, record->key + ParametersKeyLength);
+
+		key.push_back(record->limit);
+		this->index.emplace(key, reinterpret_cast<const long *>(record + 1));
+		offset += size;
+	}
+
+	/* Anything past the last complete record is left from an interrupted
+	 * append, and is cut off so the next append starts at a record. */
+	if (offset != this->mappingSize && ftruncate(this->file, offset) != 0) {
+		std::cerr << "Cannot repair the series store " << path << ".\n";
+		return false;
+	}
+
+	lseek(this->file, offset, SEEK_SET);
+	return true;
+}
+
+/* Looks up the $q$-series determined by the parameters, truncated at the
+ * limit of the given series, and copies its coefficients there if found. */
+bool SeriesStore::find(Parameters& parameters, QSeries& series)
+{
+	int encoding[ParametersKeyLength];
+
+	if (this->index.empty()) return false;
+
+	parameters.encode(encoding);
+
+	std::vector<int> key(encoding, encoding + ParametersKeyLength);
+
+	key.push_back(series.limit);
+
+	auto entry = this->index.find(key);
+
+	if (entry == this->index.end()) return false;
+
+	std::memcpy(series.coefficients, entry->second,
+				series.limit * sizeof(long));
+	return true;
+}
+
+/* Appends the $q$-series determined by the parameters to the file. */
+void SeriesStore::insert(Parameters& parameters, QSeries& series)
+{
+	Record record = {};
+	std::scoped_lock<std::mutex> lock(this->appendLock);
+
+	if (this->file < 0) return;
+
+	parameters.encode(record.key);
+	record.limit = series.limit;
+
+	/* If the file cannot take more records, stop appending. Any partial
+	 * record left behind is dropped the next time the store is opened. */
+	if (write(this->file, &record, sizeof(Record)) != sizeof(Record)
+		|| write(this->file, series.coefficients, series.limit * sizeof(long))
+		   != static_cast<long>(series.limit * sizeof(long))) {
+
+		std::cerr << "Cannot append to the series store, so no more series "
+					 "will be stored.\n";
+		close(this->file);
+		this->file = -1;
+	}
+}
+
+SeriesStore::~SeriesStore(void)
+{
+	if (this->mapping != nullptr) {
+		munmap(const_cast<char *>(this->mapping), this->mappingSize);
+	}
+
+	if (this->file >= 0) {
+		close(this->file);
+	}
+}
+
+};
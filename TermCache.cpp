@@ -0,0 +1,111 @@
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* Returns whether the two parameters have the same shape and symbols, so
+ * that the product of their $q$-Pochhammer symbols and $q$-binomial factor
+ * is the same at every tuple of indices. */
+static bool sameSymbols(Parameters& first, Parameters& second)
+{
+	if (first.indicesInUse != second.indicesInUse
+		|| first.qPSInUse != second.qPSInUse
+		|| first.qBinomialDilation != second.qBinomialDilation) {
+
+		return false;
+	}
+
+	for (int nIndex = 0; nIndex < first.qPSInUse; ++nIndex) {
+		auto& symbol = first.qPS[nIndex];
+		auto& other = second.qPS[nIndex];
+
+		if (symbol.dilation1 != other.dilation1
+			|| symbol.dilation2 != other.dilation2
+			|| symbol.negativePrefix != other.negativePrefix
+			|| symbol.power != other.power) {
+
+			return false;
+		}
+
+		for (int kIndex = 0; kIndex < first.indicesInUse; ++kIndex) {
+			if (symbol.subScalars[kIndex] != other.subScalars[kIndex]) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* Returns the cache of the calling thread, holding products for the given
+ * parameters, after emptying it if it held them for other symbols. Returns
+ * nullptr if the products are all 1, or if the parameters have too many
+ * indices to keep them. */
+TermCache *TermCache::local(Parameters& parameters)
+{
+	thread_local TermCache cache;
+	long tuples = 1;
+
+	if (parameters.qPSInUse == 0 && (parameters.qBinomialDilation == 0
+		|| parameters.indicesInUse < 2)) {
+
+		return nullptr;
+	}
+
+	for (int index = 0; index < parameters.indicesInUse; ++index) {
+		tuples *= MaxSeriesLimit;
+	}
+
+	if (tuples > MaxCachedTuples) return nullptr;
+
+	if (cache.offsets.empty() || !sameSymbols(cache.symbols, parameters)) {
+		cache.symbols = parameters;
+		cache.offsets.assign(tuples, -1);
+		cache.lengths.assign(tuples, 0);
+		cache.coefficients.clear();
+	}
+
+	return &cache;
+}
+
+/* The index of the tuple in offsets and lengths. */
+int TermCache::slot(int (&indices)[MaxIndices])
+{
+	int slot = 0;
+
+	for (int index = this->symbols.indicesInUse - 1; index >= 0; --index) {
+		slot = slot * MaxSeriesLimit + indices[index];
+	}
+
+	return slot;
+}
+
+/* Returns the product at the tuple if at least the given number of its
+ * coefficients are kept, and nullptr otherwise. The pointer is only good
+ * until the next insertion. */
+const long *TermCache::find(int (&indices)[MaxIndices], int length)
+{
+	int slot = this->slot(indices);
+
+	if (this->offsets[slot] < 0 || this->lengths[slot] < length) {
+		return nullptr;
+	}
+
+	return this->coefficients.data() + this->offsets[slot];
+}
+
+/* Keeps the series as the product at the tuple, replacing a shorter one
+ * kept before, unless the cache is full. */
+void TermCache::insert(int (&indices)[MaxIndices], QSeries& series)
+{
+	int slot = this->slot(indices);
+	long size = this->coefficients.size();
+
+	if (size + series.limit > MaxCachedCoefficients) return;
+
+	this->offsets[slot] = size;
+	this->lengths[slot] = series.limit;
+	this->coefficients.insert(this->coefficients.end(), series.coefficients,
+							  series.coefficients + series.limit);
+}
+
+};
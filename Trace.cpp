@@ -0,0 +1,132 @@
+#ifdef BQSPC_TRACE
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include "bqspc.h"
+
+namespace bqspc {
+
+/* The file the folded stacks are written to, in the format taken by
+ * flamegraph.pl, while the histograms are written to stderr. */
+const static char *TraceFoldedPath = "bqspc.folded";
+
+/* Names of the timed points, in the order they are numbered. */
+const static char *TraceNames[TracePoints] = {
+	"qSeries", "qSeriesShape", "qSeriesTerm", "applyQPochhammer",
+	"qPochhammer", "raiseToPower", "reciprocal", "factorize", "verify"
+};
+
+/* Every log created so far, and a lock to hold while adding to them. */
+static std::mutex traceRegistryLock;
+static std::vector<TraceLog *> traceRegistry;
+
+/* Returns the log of the calling thread, creating it on first use. */
+TraceLog& TraceLog::local(void)
+{
+	thread_local TraceLog *log = nullptr;
+
+	if (log == nullptr) {
+		std::scoped_lock<std::mutex> lock(traceRegistryLock);
+
+		log = new TraceLog();
+		traceRegistry.push_back(log);
+	}
+
+	return *log;
+}
+
+/* Adds up the logs of every thread and writes out the histograms of each
+ * shape and point that was called, and the folded stacks. */
+void TraceLog::dump(void)
+{
+	TraceLog *total = new TraceLog();
+	std::map<std::string, long> folded;
+	std::ofstream file(TraceFoldedPath);
+
+	std::scoped_lock<std::mutex> lock(traceRegistryLock);
+
+	for (TraceLog *log : traceRegistry) {
+		for (int shape = 0; shape < ShapeCount; ++shape) {
+			for (int point = 0; point < TracePoints; ++point) {
+				for (int bucket = 0; bucket < TraceBuckets; ++bucket) {
+					total->histograms[shape][point][bucket]
+						+= log->histograms[shape][point][bucket];
+				}
+
+				total->cycles[shape][point] += log->cycles[shape][point];
+			}
+		}
+
+		/* Spell out each stack key, outermost call first. */
+		for (auto& [key, cycles] : log->stacks) {
+			int shape = key >> 32;
+			std::string frames = "shape_"
+							   + std::to_string(Parameters::shapeIndices(shape))
+							   + "_"
+							   + std::to_string(Parameters::shapeQPS(shape));
+			int points[TraceDepth];
+			int depth = 0;
+
+			if (Parameters::shapeQBinomial(shape)) frames += "_binomial";
+
+			for (long stack = key & 0xffffffffL; stack != 0; stack /= 16) {
+				points[depth++] = stack % 16 - 1;
+			}
+
+			while (depth > 0) {
+				frames += ';';
+				frames += TraceNames[points[--depth]];
+			}
+
+			folded[frames] += cycles;
+		}
+	}
+
+	for (auto& [frames, cycles] : folded) {
+		file << frames << ' ' << cycles << '\n';
+	}
+
+	for (int shape = 0; shape < ShapeCount; ++shape) {
+		for (int point = 0; point < TracePoints; ++point) {
+			long calls = 0;
+
+			for (int bucket = 0; bucket < TraceBuckets; ++bucket) {
+				calls += total->histograms[shape][point][bucket];
+			}
+
+			if (calls == 0) continue;
+
+			std::cerr << "# " << Parameters::shapeIndices(shape)
+					  << " indices, " << Parameters::shapeQPS(shape)
+					  << " q-Pochhammer symbols, "
+					  << (Parameters::shapeQBinomial(shape)
+						  ? "a q-binomial, " : "")
+					  << TraceNames[point] << ": " << calls << " calls, "
+					  << total->cycles[shape][point] / calls
+					  << " cycles each\n";
+
+			for (int bucket = 0; bucket < TraceBuckets; ++bucket) {
+				long count = total->histograms[shape][point][bucket];
+
+				if (count == 0) continue;
+
+				std::cerr << "2^" << bucket << ' ' << count << '\n';
+			}
+		}
+	}
+
+	delete total;
+}
+
+/* Writes the logs out when the program exits, as the last static object
+ * of this file to be destroyed is the first. */
+static struct TraceDumper
+{
+	~TraceDumper(void) {TraceLog::dump();}
+} traceDumper;
+
+};
+
+#endif
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <iostream>
 #include <mutex>
 #include <string>
@@ -7,9 +8,10 @@
 namespace bqspc
 {
 
-/* Prints out a conjectured sum-product identity fully formatted for LaTeX. */
+/* Writes out a conjectured sum-product identity fully formatted for LaTeX. */
 void WorkerThread::reportIdentity(Parameters& parameters,
-								  ProductSignature &signature)
+								  ProductSignature &signature,
+								  std::ostream& stream)
 {
 	std::string sum;
 	std::string prod;
@@ -69,7 +71,7 @@ void WorkerThread::reportIdentity(Parameters& parameters,
 			std::string term;
 
 			int mIndex = nIndex * (parameters.indicesInUse - 1)
-					   - nIndex * (nIndex - 1) / 2 + kIndex - 1;
+					   - nIndex * (nIndex + 1) / 2 + kIndex - 1;
 
 			if (parameters.qScalarsDegree2Mixed[mIndex] == 0) {
 				continue;
@@ -111,6 +113,11 @@ void WorkerThread::reportIdentity(Parameters& parameters,
 
 	sumNum += "}";
 
+	if (parameters.qBinomialDilation > 0) {
+		sumNum += "{n_{0} \\brack n_{1}}_{"
+				+ prettyPrint(parameters.qBinomialDilation) + "}";
+	}
+
 	/* The $q$-Pochhammer symbols. */
 	for (int nIndex = 0; nIndex < parameters.qPSInUse; ++nIndex) {
 		int powerAbs = parameters.qPS[nIndex].power;
@@ -128,7 +135,7 @@ void WorkerThread::reportIdentity(Parameters& parameters,
 			qPS += prettyPrint(parameters.qPS[nIndex].dilation1);
 		}
 
-		qPS += "; " + prettyPrint(parameters.qPS[nIndex].dilation1) + ")_{";
+		qPS += "; " + prettyPrint(parameters.qPS[nIndex].dilation2) + ")_{";
 
 		powerUsePlus = false;
 
@@ -214,48 +221,333 @@ void WorkerThread::reportIdentity(Parameters& parameters,
 		}
 	}
 
-	/* Write the result to stdout. This is threadsafe and does not require
-	 * holding a mutex. */
-	output << "\\begin{equation}\n" + sum + " = "
+	/* Write the result, recording the truncation the identity was verified to
+	 * as a LaTeX comment. Writing to std::cout this way is threadsafe and
+	 * does not require holding a mutex. */
+	output << "% Verified up to q^" + std::to_string(signature.limit) + ".\n"
+			  "\\begin{equation}\n" + sum + " = "
 			  + prod + "\n\\end{equation}\n";
-	std::cout << output.str();
+	stream << output.str();
 }
 
-/* Attempts to find a sum-product identity from the given parameters. */
-void WorkerThread::tryCombination(Parameters& parameters)
+/* Returns the nanoseconds from start until now, and moves start to now. */
+static long lap(std::chrono::steady_clock::time_point& start)
 {
-	ProductSignature signature;
-	QSeries candidate;
+	auto now = std::chrono::steady_clock::now();
+	long nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					   now - start).count();
 
-	/* Generate the $q$-series coefficients and factor them. */
-	candidate.qSeries(parameters);
-	signature.factorize(candidate);
+	start = now;
+	return nanoseconds;
+}
 
-	/* If there is no sum-product identity found or if the identity is dilated
-	 * then this parameter combination is considered a failure. */
-	if (signature.period == 0 || signature.dilation() > 1) return;
+/* Reports on standard error if the closed form recognized for the attempt
+ * disagrees with its $q$-series, which is in a power of $q$ if dilated is
+ * set, or with the signature factorized from it otherwise. */
+void WorkerThread::checkClosedForm(Attempt& attempt, bool dilated)
+{
+	ProductSignature& expected = attempt.closedForm;
+	ProductSignature& found = attempt.signature;
+	bool agrees = (attempt.closedFormGCD > 1) == dilated;
 
-	/* Otherwise, report the identity and move on. */
-	this->reportIdentity(parameters, signature);
+	if (!dilated && agrees) {
+		agrees = expected.period == found.period;
+
+		for (int index = 0; agrees && index < found.period; ++index) {
+			agrees = expected.powers[index] == found.powers[index];
+		}
+	}
+
+	if (agrees) return;
+
+	/* The report is written at once so that reports from other threads do
+	 * not interleave with it. */
+	std::stringstream output;
+
+	output << "The closed form disagrees with the series of ";
+	attempt.parameters.write(output);
+	output << ": expected ";
+	expected.write(output);
+	output << " with support GCD " << attempt.closedFormGCD << ", found ";
+
+	if (dilated) {
+		output << "a dilated series";
+	} else {
+		found.write(output);
+	}
+
+	output << ".\n";
+	std::cerr << output.str();
 }
 
-/* Acquires and executes jobs from the generator on loop. */
+/* Starts trying the parameters of the attempt, and returns whether its
+ * $q$-series is still a candidate to factorize. Parameters that cannot give
+ * a convergent series, or that give one in a power of $q$, are rejected
+ * before any arithmetic. Sums whose product is known in closed form are
+ * settled without their series, unless the closed forms are being checked:
+ * those without a product are rejected, and the others are left pending
+ * with the known signature, for conclude to look up. None of this is done
+ * for a source that does not reject parameters early, whose every series
+ * is factorized. */
+bool WorkerThread::prepare(Attempt& attempt)
+{
+	auto start = std::chrono::steady_clock::now();
+	bool early = this->scheduler->jobSource()->rejectsEarly();
+
+	attempt.pending = false;
+	attempt.recognized = false;
+	attempt.nanoseconds = 0;
+	attempt.seriesNanoseconds = 0;
+	attempt.factorizeNanoseconds = 0;
+	attempt.signature.period = 0;
+	BQSPC_TRACE_SHAPE(attempt.parameters.shape());
+
+	if (early && attempt.parameters.hasFlatAxis()) {
+		this->rejections[RejectedFlatAxis]++;
+		attempt.nanoseconds += lap(start);
+		return false;
+	}
+
+	if (early && attempt.parameters.powerGCD() > 1) {
+		this->rejections[RejectedDilatedParameters]++;
+		attempt.nanoseconds += lap(start);
+		return false;
+	}
+
+	/* The closed form is taken as far as verification would have gone. */
+	attempt.closedFormGCD = 0;
+
+	if (early) {
+		attempt.closedFormGCD = attempt.closedForm.closedForm(
+								attempt.parameters, MaxVerificationLimit);
+	}
+
+	if (attempt.closedFormGCD > 1 && !this->scheduler->checkClosedForms) {
+		this->rejections[RejectedDilatedSeries]++;
+		attempt.nanoseconds += lap(start);
+		return false;
+	}
+
+	if (attempt.closedFormGCD == 1 && attempt.closedForm.period == 0
+		&& !this->scheduler->checkClosedForms) {
+
+		this->rejections[RejectedNoPattern]++;
+		attempt.nanoseconds += lap(start);
+		return false;
+	}
+
+	if (attempt.closedFormGCD == 1 && !this->scheduler->checkClosedForms) {
+		attempt.signature = attempt.closedForm;
+		attempt.recognized = true;
+		attempt.pending = true;
+		attempt.nanoseconds += lap(start);
+		return false;
+	}
+
+	/* Generate the $q$-series coefficients, unless a previous run stored
+	 * them. */
+	if (this->store == nullptr
+		|| !this->store->find(attempt.parameters, attempt.candidate)) {
+
+		this->scheduler->evaluate(attempt.parameters, attempt.candidate);
+
+		if (this->store != nullptr) {
+			this->store->insert(attempt.parameters, attempt.candidate);
+		}
+	}
+
+	attempt.seriesNanoseconds = lap(start);
+	attempt.nanoseconds += attempt.seriesNanoseconds;
+
+	/* The factorization of a series in a power of $q$ could only ever be
+	 * dilated, so it is not computed. */
+	bool dilated = attempt.candidate.supportGCD() > 1;
+
+	if (this->scheduler->checkClosedForms && attempt.closedFormGCD > 0
+		&& dilated) {
+
+		this->checkClosedForm(attempt, true);
+	}
+
+	if (early && dilated) {
+		this->rejections[RejectedDilatedSeries]++;
+		attempt.nanoseconds += lap(start);
+		return false;
+	}
+
+	attempt.nanoseconds += lap(start);
+	attempt.pending = true;
+	return true;
+}
+
+/* Finishes trying an attempt whose $q$-series is still a candidate, and
+ * returns whether a new identity was found. Unless products are being
+ * matched, the series must have been factorized into the signature. The
+ * signature is left with period 0 if there was no pattern at all, and
+ * otherwise with the pattern and the limit up to which it was checked, even
+ * if it was then rejected. A sum recognized by prepare already has its
+ * signature from the closed form, which is a theorem, so it is only looked
+ * up and never verified. */
+bool WorkerThread::conclude(Attempt& attempt)
+{
+	ProductSignature& signature = attempt.signature;
+	auto start = std::chrono::steady_clock::now();
+
+	if (attempt.recognized) {
+		bool identity = false;
+
+		if (this->index != nullptr && !this->index->contains(signature)) {
+			this->rejections[RejectedNoMatch]++;
+		} else if (this->index == nullptr && signature.dilation() > 1) {
+			this->rejections[RejectedDilatedProduct]++;
+		} else if (this->catalog != nullptr
+				   && this->catalog->contains(signature, nullptr)) {
+
+			this->catalog->matches++;
+		} else {
+			identity = true;
+		}
+
+		attempt.nanoseconds += lap(start);
+		return identity;
+	}
+
+	/* When searching for particular products, the series only has to be
+	 * looked up among them. */
+	if (this->index != nullptr) {
+		bool matched = this->index->match(attempt.candidate, signature);
+		long nanoseconds = lap(start);
+
+		attempt.factorizeNanoseconds += nanoseconds;
+		attempt.nanoseconds += nanoseconds;
+
+		if (!matched) {
+			this->rejections[RejectedNoMatch]++;
+			return false;
+		}
+	} else {
+		if (this->scheduler->checkClosedForms
+			&& attempt.closedFormGCD > 0) {
+
+			this->checkClosedForm(attempt, false);
+		}
+
+		/* If there is no sum-product identity found or if the identity is
+		 * dilated then this parameter combination is considered a failure. */
+		if (signature.period == 0) {
+			this->rejections[RejectedNoPattern]++;
+			attempt.nanoseconds += lap(start);
+			return false;
+		}
+
+		if (signature.dilation() > 1) {
+			this->rejections[RejectedDilatedProduct]++;
+			attempt.nanoseconds += lap(start);
+			return false;
+		}
+	}
+
+	/* Known identities are only counted. */
+	if (this->catalog != nullptr
+		&& this->catalog->contains(signature, &attempt.candidate)) {
+
+		this->catalog->matches++;
+		attempt.nanoseconds += lap(start);
+		return false;
+	}
+
+	/* The pattern was only checked against the search truncation, so extend
+	 * the series and its factorization to confirm it before reporting. */
+	QSeries extended(MaxVerificationLimit);
+
+	attempt.nanoseconds += lap(start);
+
+	if (this->store == nullptr
+		|| !this->store->find(attempt.parameters, extended)) {
+
+		this->scheduler->evaluate(attempt.parameters, extended);
+
+		if (this->store != nullptr) {
+			this->store->insert(attempt.parameters, extended);
+		}
+	}
+
+	long nanoseconds = lap(start);
+
+	attempt.seriesNanoseconds += nanoseconds;
+	attempt.nanoseconds += nanoseconds;
+
+	bool verified = signature.verify(extended);
+
+	nanoseconds = lap(start);
+	attempt.factorizeNanoseconds += nanoseconds;
+	attempt.nanoseconds += nanoseconds;
+
+	if (!verified) {
+		this->rejections[RejectedUnverified]++;
+	}
+
+	return verified;
+}
+
+/* Acquires and executes jobs from the scheduler on loop. Along with each
+ * job taken, as many of the jobs already queued for this worker as fit are
+ * tried with it, so that their $q$-series can be factorized as one batch.
+ * Waiting for more jobs to fill a batch could hold back finished ones, so
+ * batches may be partly empty. Each job is timed so the scheduler can size
+ * later batches, with the time of a batch factorization split evenly, and
+ * its outcome is handed back to where it came from. */
 void WorkerThread::jobLoop(void)
 {
-	for (;;) {
+	Attempt attempts[BatchLanes];
+
+	while (this->scheduler->next(*this, attempts[0].parameters)) {
+		QSeries *batch[BatchLanes];
+		ProductSignature *signatures[BatchLanes];
+		int count = 1;
+		int pending = 0;
+
+		while (count < BatchLanes
+			   && this->scheduler->nextQueued(*this,
+											  attempts[count].parameters)) {
 
-		/* Get some work. */
-		this->generator->populate(*this);
+			++count;
+		}
+
+		for (int lane = 0; lane < count; ++lane) {
+			if (this->prepare(attempts[lane]) && this->index == nullptr) {
+				batch[pending] = &attempts[lane].candidate;
+				signatures[pending++] = &attempts[lane].signature;
+			}
+		}
+
+		if (pending > 0) {
+			auto start = std::chrono::steady_clock::now();
+
+			ProductSignature::factorizeBatch(batch, signatures, pending);
 
-		/* The generator will notify the worker threads that
-		 * the work is finished by not providing any jobs here. */
-		if (this->jobQueueLength == 0) return;
+			long share = lap(start) / pending;
 
-		for (int index = 0; index < this->jobQueueLength; ++index) {
-			this->tryCombination(*this->jobQueue[index]);
+			for (int lane = 0; lane < count; ++lane) {
+				if (!attempts[lane].pending) continue;
+
+				attempts[lane].factorizeNanoseconds += share;
+				attempts[lane].nanoseconds += share;
+			}
+		}
+
+		for (int lane = 0; lane < count; ++lane) {
+			Attempt& attempt = attempts[lane];
+			bool identity = attempt.pending && this->conclude(attempt);
+
+			this->seriesNanoseconds = attempt.seriesNanoseconds;
+			this->factorizeNanoseconds = attempt.factorizeNanoseconds;
+			this->scheduler->record(attempt.parameters, attempt.nanoseconds);
+			this->scheduler->jobSource()->finish(*this, attempt.parameters,
+												 attempt.signature, identity,
+												 attempt.nanoseconds);
 		}
 	}
 }
 
 };
-
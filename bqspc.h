@@ -1,32 +1,158 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef BQSPC_TRACE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
 
 namespace bqspc {
 
 /* The largest allowed coefficient to truncate $q$-series computations at. */
 const static int MaxSeriesLimit = 100;
 
+/* The coefficient to truncate $q$-series computations at when verifying a
+ * conjectured identity before it is reported. This also bounds the storage
+ * of every $q$-series. */
+const static int MaxVerificationLimit = 400;
+
 /* Longest pattern of powers in the truncated product to search for. */
 const static int MaxProductSignatureLength = 50;
 
+/* The largest magnitude of the power of a $q$-Pochhammer symbol in
+ * parameters read from text. Larger powers are exact too, but only make
+ * evaluation slow. */
+const static int MaxQPSPower = 60;
+
+/* The largest magnitude of a power $a_n$ in a product read from a catalog
+ * or from a file of products to match. */
+const static long MaxProductPower = 60;
+
+/* Number of leading coefficients that identify a $q$-series in the catalog
+ * of known identities. */
+const static int FingerprintLength = 20;
+
 /* The largest number of $q$-series summation indices allowed. */
-const static int MaxIndices = 2;
+const static int MaxIndices = 4;
 
 /* The largest number of distinct $q$-Pochhammer symbols allowed in a
  * single $q$-series, ignoring multiplicity. */
-const static int MaxQPS = 2;
-
-/* Number of $q$-series parameters to cache per worker thread. */
+const static int MaxQPS = 3;
+
+/* Number of distinct shapes of $q$-series, counting one through MaxIndices
+ * summation indices and zero through MaxQPS $q$-Pochhammer symbols, without
+ * a $q$-binomial factor and then again with one. The shapes with one are
+ * numbered from QBinomialShapeStart on. */
+const static int QBinomialShapeStart = MaxIndices * (MaxQPS + 1);
+const static int ShapeCount = 2 * QBinomialShapeStart;
+
+/* The number of worker threads to use. */
+const static int WorkerThreadsToUse = 10;
+
+/* The number of worker threads to use when measuring throughput, fixed so
+ * measurements stay comparable between machines and runs. */
+const static int BenchmarkThreadsToUse = 4;
+
+/* Seed for the random samples of the search space, fixed so that repeated
+ * estimates try the same combinations. */
+const static unsigned long SamplingSeed = 20240611;
+
+/* The number of consecutive combinations sampled together, so that they
+ * are tried one after another and share what a worker keeps between jobs,
+ * as they would in the search. */
+const static int SampledRunLength = 16;
+
+/* Seed for a given number of fuzzing cases, fixed so that a failure seen
+ * once is seen again. Soaking draws a fresh seed every run instead. */
+const static unsigned long FuzzSeed = 20240917;
+
+/* Reasons a candidate can be rejected for, numbering the counts kept of
+ * each: a summation index leaves the power of $q$ unchanged, every power
+ * of $q$ the parameters allow shares a divisor, every power of $q$ in the
+ * computed series shares a divisor, the factorization has no pattern, the
+ * pattern is dilated, the pattern fails verification, and the series is
+ * not one of the products searched for. */
+const static int RejectedFlatAxis = 0;
+const static int RejectedDilatedParameters = 1;
+const static int RejectedDilatedSeries = 2;
+const static int RejectedNoPattern = 3;
+const static int RejectedDilatedProduct = 4;
+const static int RejectedUnverified = 5;
+const static int RejectedNoMatch = 6;
+const static int RejectionReasons = 7;
+
+/* Largest number of $q$-series a worker thread factorizes together. */
+const static int BatchLanes = 8;
+
+/* Largest number of $q$-series parameters to hand a worker thread at once. */
 const static int JobQueueLimit = 100;
 
+/* The estimated time in nanoseconds that the parameters handed to a worker
+ * thread at once should take to try. */
+const static long TargetBatchNanoseconds = 20000000;
+
+/* The estimated time in nanoseconds above which a single $q$-series is
+ * worth evaluating on several worker threads at once, if some are idle. */
+const static long SplitNanoseconds = 10000000;
+
+/* The most tuples of indices, and the most coefficients in all, whose
+ * products of $q$-Pochhammer symbols a worker thread keeps at once. The
+ * products for three or more indices outgrow the processor caches, and
+ * reading them back then takes longer than building them again, so series
+ * with more possible tuples are evaluated without keeping any. The
+ * coefficients take 1 MiB, which leaves most of a shared cache to the other
+ * threads, and keeping more was no faster. */
+const static int MaxCachedTuples = 10000;
+const static long MaxCachedCoefficients = 1 << 17;
+
+/* Number of integers in the canonical encoding of a set of parameters. */
+const static int ParametersKeyLength = 5 + 2 * MaxIndices
+									 + MaxIndices * (MaxIndices - 1) / 2
+									 + MaxQPS * (4 + MaxIndices);
+
+/* Hashes a sequence of integers, mixing in every value so that equal
+ * sequences of any length can be found in constant time per element. */
+class SequenceHash
+{
+public:
+	template<typename Value>
+	std::size_t operator()(const std::vector<Value>& key) const
+	{
+		std::size_t hash = key.size();
+
+		for (Value value : key) {
+			hash ^= static_cast<std::size_t>(value) + 0x9e3779b97f4a7c15ULL
+				  + (hash << 6) + (hash >> 2);
+		}
+
+		return hash;
+	}
+};
+
 /* The parameters that fully determine a particular $q$-series of the form
  * $\sum_{n_0, \dots, n_\ell \geq 0} (-1)^{d \times (n_0 + \cdots + n_\ell))}
- * \times q^{c(n_0 \dots, n_\ell)} \prod_{i=0}^k
+ * \times q^{c(n_0 \dots, n_\ell)} {n_0 \brack n_1}_{q^e} \prod_{i=0}^k
  * (\pm q^{a_i};q^{b_i})_{s_i(n_0, \dots, n_\ell)}^{p_i}$, where $\ell \geq 0$
  * determines the number of summation indices to use, $d \in \{0, 1\}$, $c$ is
  * a nonnegative degree 1 or 2 polynomial in $n_0, dots, n_\ell$, $k \geq 0$
  * determines the number of $q$-Pochhammer symbols, $p_i$ is any nonzero power
  * on them, $s_i$ is a linear function in $n_0, \dots, n_\ell$ that is not
  * identically zero, and the dilations satisfy $a_i, b_i \geq 1$ with
- * $a_i = 0$ additionally allowed if $p_i > 0$. */
+ * $a_i = 0$ additionally allowed if $p_i > 0$. The $q$-binomial factor is
+ * optional, and needs $\ell \geq 1$ and $e \geq 1$ if present. */
 class Parameters
 {
 public:
@@ -43,6 +169,9 @@ public:
 
 	/* The number of distinct q-Pochhammer symbols $k + 1$ to use. */
 	int qPSInUse;
+
+	/* The dilation $e$ of the $q$-binomial factor, or 0 to leave it out. */
+	int qBinomialDilation;
 	
 	/* Coefficients of the pure degree 1 and 2 powers in $c$, respectively,
 	 * stored so the coefficient of $n_i$ and $n_i$^2 is at index $i$. */
@@ -67,25 +196,140 @@ public:
 		int power;
 		int subScalars[MaxIndices];
 	} qPS[MaxQPS];
+
+	void encode(int (&)[ParametersKeyLength]);
+	bool hasFlatAxis(void);
+	long powerGCD(void);
+	bool read(std::istream&);
+	void write(std::ostream&);
+
+	/* Numbers the shape of the $q$-series, which is its number of indices
+	 * and $q$-Pochhammer symbols and whether it has a $q$-binomial factor,
+	 * from 0 up to ShapeCount - 1. */
+	inline int shape(void)
+	{
+		return shapeOf(this->qBinomialDilation > 0, this->indicesInUse,
+					   this->qPSInUse);
+	}
+
+	/* The number of the shape with the given parts, and the parts of a shape
+	 * number, in the order of shape. */
+	static constexpr int shapeOf(bool qBinomial, int indices, int qPS)
+	{
+		return qBinomial * QBinomialShapeStart + (indices - 1) * (MaxQPS + 1)
+			 + qPS;
+	}
+
+	static constexpr bool shapeQBinomial(int shape)
+	{
+		return shape >= QBinomialShapeStart;
+	}
+
+	static constexpr int shapeIndices(int shape)
+	{
+		return shape % QBinomialShapeStart / (MaxQPS + 1) + 1;
+	}
+
+	static constexpr int shapeQPS(int shape)
+	{
+		return shape % (MaxQPS + 1);
+	}
 };
 
+class ProductIndex;
+class ProductSignature;
 class WorkerThread;
 
-/* Iterates through all parameter combinations to provide the threads work. */
-class ParameterGenerator : private Parameters
+/* Somewhere the scheduler takes parameter combinations to try from, and
+ * which decides what happens to the outcome of each one. */
+class JobSource
 {
-	friend class WorkerThread;
+public:
+
+	/* Appends up to count parameter combinations to the queue, and returns
+	 * the number appended, which is 0 only once there will never be more.
+	 * This may block until more are available. The scheduler calls this
+	 * from one thread at a time. */
+	virtual int populate(std::deque<Parameters>&, int) = 0;
+
+	/* Returns the shape of the parameters populate would give out next, or
+	 * -1 if that is not known yet. */
+	virtual int nextShape(void) = 0;
+
+	/* Receives the outcome of trying the parameters on the worker thread,
+	 * which is whether they give a new identity, the product signature that
+	 * was found, and the time in nanoseconds it took. This is called from
+	 * every worker thread concurrently. */
+	virtual void finish(WorkerThread&, Parameters&, ProductSignature&, bool,
+						long) = 0;
+
+	/* Returns whether parameters that cannot give a new identity may be
+	 * rejected before their product signature is found, leaving it with
+	 * period 0. Sources that need the signature of every combination
+	 * return false. */
+	virtual bool rejectsEarly(void) {return true;}
+
+	virtual ~JobSource(void) {}
+};
+
+/* The largest values the parameter generator allows for the respective
+ * parameters, the range of the number of summation indices, and the largest
+ * number of $q$-Pochhammer symbols, which may be raised as far as MaxIndices
+ * and MaxQPS respectively. They default to the search this program was
+ * built for, and can be changed for a run as described for read. */
+class SearchBounds
+{
+public:
+	int Max_qScalarsDegree1;
+	int Max_qScalarsDegree2Pure;
+	int Max_qScalarsDegree2Mixed;
+	int Max_qPS_power;
+	int Max_qPS_dilation1;
+	int Max_qPS_dilation2;
+	int Max_qPS_subScalars;
+	int Max_qBinomial_dilation;
+	int Min_indicesInUse;
+	int Max_indicesInUse;
+	int Max_qPSInUse;
+
+	bool read(const char *);
+
+	SearchBounds(void);
+};
 
+/* Iterates through all parameter combinations within its bounds to provide
+ * the threads work, and reports every identity found from them. Given a
+ * generator to exclude, the combinations that generator gives out are
+ * skipped, so that after a bound is raised only the combinations it adds
+ * are searched. */
+class ParameterGenerator : public JobSource, private Parameters
+{
 	bool continueWorking;
+	SearchBounds bounds;
+	ParameterGenerator *excluded;
 
 	void advance(void);
-	void populate(WorkerThread&);
+	void skipExcluded(void);
 
 public:
-	ParameterGenerator(void);
+	int populate(std::deque<Parameters>&, int) override;
+	int nextShape(void) override;
+	void finish(WorkerThread&, Parameters&, ProductSignature&, bool,
+				long) override;
+	long shapeSize(int);
+	long shapeStart(int);
+	long regionSize(int);
+	long combinations(void);
+	long position(Parameters&);
+	bool gives(Parameters&);
+	void seek(long);
+	void exclude(ParameterGenerator *);
+
+	ParameterGenerator(const SearchBounds& = SearchBounds());
 };
 
 class QSeries;
+class TermCache;
 
 /* Encodes the product signature of a truncated $q$-series, which is the
  * minimal length pattern $a_1, \dots, a_\ell$ of repeating powers appearing
@@ -93,6 +337,9 @@ class QSeries;
  * $\prod_{n \geq 1} \frac{1}{(1-q^n)^{a_n}}$, if such a pattern exists. */
 class ProductSignature
 {
+	friend class Catalog;
+	friend class Fuzzer;
+	friend class ProductIndex;
 	friend class QSeries;
 	friend class WorkerThread;
 
@@ -102,22 +349,39 @@ class ProductSignature
 	/* The sequence of powers that forms the pattern. */
 	long powers[MaxProductSignatureLength];
 
+	/* The coefficient up to which the pattern is known to hold. */
+	int limit;
+
 	long pairwiseGCD(long, long);
+	void findPattern(const long *, int);
 
 public:
 	long dilation(void);
+	void reduce(void);
 	void factorize(QSeries&);
+	long closedForm(Parameters&, int);
+	static void factorizeBatch(QSeries **, ProductSignature **, int);
+	void expand(QSeries&);
+	bool verify(QSeries&);
+	bool read(std::istream&, const char *, int);
+	void write(std::ostream&);
 };
 
 /* Stores the truncated coefficients of a $q$-series, and provides all
  * functionality for truncated $q$-series arithmetic and manipulations. */
 class QSeries
 {
+	friend class Catalog;
+	friend class Fuzzer;
+	friend class ProductIndex;
 	friend class ProductSignature;
+	friend class Scheduler;
+	friend class SeriesStore;
+	friend class TermCache;
 
 	/* The $q$-series coefficients, stored so the coefficient of $q^i$ is at
 	 * the index $i$. */
-	long coefficients[MaxSeriesLimit];
+	long coefficients[MaxVerificationLimit];
 
 	/* The coefficient to truncate all computations at. */
 	int limit;
@@ -125,20 +389,39 @@ class QSeries
 	void reciprocal(void);
 	void raiseToPower(int);
 	void qPochhammer(int, int, bool, int);
-	void qBinomial(int, int);
+	void applyFactor(int, bool, int);
+	void applyQPochhammer(int, int, bool, int, int);
+	void applyQBinomial(int, int, int);
 	int qSeriesPower(Parameters&, int (&)[MaxIndices]);
 	void qSeriesTerm(Parameters&, int (&)[MaxIndices]);
 
+	/* Evaluators specialized to a fixed number of indices and $q$-Pochhammer
+	 * symbols in use, and to a fixed limit, so their loops can be unrolled
+	 * and their bounds folded at compile time. */
+	template<int Indices>
+	int qSeriesPowerShape(Parameters&, int (&)[MaxIndices]);
+	template<int Indices, int QPS, bool QBinomial, int Limit, int Depth>
+	void qSeriesNested(Parameters&, int (&)[MaxIndices], int (&)[MaxQPS],
+					   QSeries&, TermCache *, int, int, int);
+	template<int Indices, int QPS, bool QBinomial, int Limit>
+	void qSeriesShape(Parameters&, int, int);
+
 public:
 
-	void qSeries(Parameters&);
+	/* A method computing the $q$-series determined by some parameters, or
+	 * the part of it given by the last two arguments as in qSeries. */
+	typedef void (QSeries::*Kernel)(Parameters&, int, int);
+
+	void qSeries(Parameters&, int = 0, int = 1);
+	static Kernel kernel(Parameters&, int);
+	long supportGCD(void);
 
 	QSeries(int limit = MaxSeriesLimit) {this->limit = limit;}
 
 	/* Sets all coefficients to zero. */
 	inline void zero(void)
 	{
-		for (int index = 0; index < MaxSeriesLimit; ++index) {
+		for (int index = 0; index < this->limit; ++index) {
 			this->coefficients[index] = 0;
 		}
 	}
@@ -239,41 +522,751 @@ public:
 	}
 };
 
-/* Data and methods for each worker thread. */
-class WorkerThread
+/* The $q$-binomial coefficients ${n \brack k}_q$ truncated at a limit. Rows
+ * are computed with the $q$-Pascal recurrence the first time they are
+ * needed and kept, so each coefficient costs a single addition once per
+ * thread rather than a division of $q$-Pochhammer symbols every time. */
+class QBinomialTable
+{
+	/* The coefficient every entry is truncated at. */
+	int limit;
+
+	/* The coefficients of ${n \brack k}_q$ for $0 \leq k \leq n$ are at
+	 * index $n(n+1)/2 + k$, leaving out the zeros past its degree. */
+	std::vector<std::vector<long>> entries;
+
+public:
+	static QBinomialTable& local(int);
+	const std::vector<long>& entry(int, int);
+
+	QBinomialTable(void) {this->limit = 0;}
+};
+
+/* The products of the $q$-Pochhammer symbols and the $q$-binomial factor
+ * at the tuples of indices a kernel visited while evaluating a series up to
+ * MaxSeriesLimit, kept per thread for the last combination of them. The
+ * generator counts the coefficients of $c(n_0, \dots, n_\ell)$ as its
+ * least significant digits, so the jobs a worker takes one after another
+ * mostly share their symbols, and their terms are read back from here
+ * instead of being built one factor at a time. */
+class TermCache
 {
-	friend class ParameterGenerator;
+	/* The parameters the products are for, of which only the shape and the
+	 * symbols matter. */
+	Parameters symbols;
 
-	/* Points to the universal generator. */
-	ParameterGenerator *generator;
+	/* Where the product at each tuple starts in coefficients, or -1 if it
+	 * is not kept, and how many of its coefficients are kept. A tuple is
+	 * at the index given by reading the indices as the digits of a number
+	 * in base MaxSeriesLimit, least significant first. */
+	std::vector<int> offsets;
+	std::vector<int> lengths;
 
-	/* Cache of parameters to try. */
-	Parameters *jobQueue[JobQueueLimit];
+	/* The coefficients of every product kept, one after another. */
+	std::vector<long> coefficients;
 
-	/* Number of parameters in the cache. */
-	int jobQueueLength;
+	int slot(int (&)[MaxIndices]);
 
-	void reportIdentity(Parameters&, ProductSignature&);
-	void tryCombination(Parameters&);
+public:
+	static TermCache *local(Parameters&);
+	const long *find(int (&)[MaxIndices], int);
+	void insert(int (&)[MaxIndices], QSeries&);
+};
+
+/* A collection of identities that are already known, so that workers can
+ * count them instead of reporting them again. Entries are loaded from a text
+ * file and are either product signatures or fingerprints of $q$-series. */
+class Catalog
+{
+	/* Known product signatures, stored as the period followed by the
+	 * powers of the minimal pattern. */
+	std::unordered_set<std::vector<long>, SequenceHash> products;
+
+	/* Known $q$-series, stored as their first FingerprintLength
+	 * coefficients. */
+	std::unordered_set<std::vector<long>, SequenceHash> fingerprints;
 
 public:
-	void jobLoop(void);
 
-	WorkerThread(ParameterGenerator *generator)
+	/* The number of candidates found to be in the catalog so far. */
+	std::atomic<long> matches;
+
+	bool load(const char *);
+	bool contains(ProductSignature&, QSeries *);
+
+	Catalog(void) {this->matches = 0;}
+};
+
+/* A family of infinite products to search for instead of every product
+ * signature, loaded from a text file. Each product is expanded once into a
+ * truncated $q$-series, and the expansions are indexed by their first
+ * FingerprintLength coefficients, so that a candidate $q$-series is matched
+ * by one lookup and a comparison rather than by factorizing it. */
+class ProductIndex
+{
+	/* The products and their expansions up to MaxSeriesLimit, at equal
+	 * positions. */
+	std::vector<ProductSignature> products;
+	std::vector<QSeries> expansions;
+
+	/* The positions of the products with each sequence of leading
+	 * coefficients. */
+	std::unordered_map<std::vector<long>, std::vector<int>, SequenceHash>
+		prefixes;
+
+	/* The products, each stored as the period followed by the powers of
+	 * its minimal pattern. */
+	std::unordered_set<std::vector<long>, SequenceHash> patterns;
+
+	void add(ProductSignature&);
+
+public:
+	bool load(const char *);
+	bool match(QSeries&, ProductSignature&);
+	bool contains(ProductSignature&);
+
+	/* The number of products searched for. */
+	inline int size(void) {return this->products.size();}
+};
+
+/* A file of computed $q$-series coefficients, keyed by the canonical
+ * encoding of their parameters and their limit, that persists across runs.
+ * The file is memory mapped when opened and its records are indexed in place,
+ * so opening it reads no coefficients and a lookup only copies out the one
+ * series found. Series computed during the run are appended to the file, and
+ * become available to lookups from the next run onwards. Only one process
+ * may use a file at a time, and a file written by a build with another
+ * version of the arithmetic is refused. */
+class SeriesStore
+{
+	/* The header of each record in the file, which is immediately followed
+	 * by limit coefficients. */
+	class alignas(long) Record
+	{
+	public:
+		int key[ParametersKeyLength];
+		int limit;
+	};
+
+	/* The file descriptor of the store, or -1 if it is not open. */
+	int file;
+
+	/* The mapping of the file as it was when opened, and its size. */
+	const char *mapping;
+	long mappingSize;
+
+	/* Maps the encoded parameters, followed by the limit, to the stored
+	 * coefficients inside the mapping. */
+	std::unordered_map<std::vector<int>, const long *, SequenceHash> index;
+
+	/* Must be held while appending to the file. */
+	std::mutex appendLock;
+
+public:
+	bool open(const char *);
+	bool find(Parameters&, QSeries&);
+	void insert(Parameters&, QSeries&);
+
+	SeriesStore(void)
+	{
+		this->file = -1;
+		this->mapping = nullptr;
+		this->mappingSize = 0;
+	}
+
+	~SeriesStore(void);
+};
+
+/* Hands out the parameter combinations from a job source to the worker
+ * threads. Each worker has its own queue of jobs, which it refills from the
+ * source with a batch sized from the measured cost of the shape of the next
+ * jobs, so that every batch takes about TargetBatchNanoseconds. Once the
+ * source is exhausted, workers that run out of jobs steal half of the
+ * remaining jobs of another worker, keeping every thread busy to the end. */
+class Scheduler
+{
+	/* A $q$-series split by the remainder of $n_0$ into parts, which any
+	 * worker may claim and compute into the partial series of the part. */
+	class SharedEvaluation
+	{
+	public:
+		Parameters parameters;
+		QSeries::Kernel kernel;
+		int parts;
+		int claimed;
+		int finished;
+		std::vector<QSeries> partials;
+	};
+
+	/* Points to where the jobs come from. */
+	JobSource *source;
+
+	/* Every worker thread taking jobs from this scheduler. */
+	std::vector<WorkerThread *> workers;
+
+	/* The running average time in nanoseconds to try one parameter
+	 * combination of each shape, or 0 if none has been timed yet. */
+	std::atomic<long> costs[ShapeCount];
+
+	/* The same, for evaluating one $q$-series of each shape up to
+	 * MaxSeriesLimit and up to MaxVerificationLimit. */
+	std::atomic<long> seriesCosts[2][ShapeCount];
+
+	/* Guards the fields below, which workers without a job wait on. Only
+	 * one worker at a time may ask the job source for jobs, and the rest
+	 * wait for it instead of a mutex so they can help with evaluations
+	 * shared in the meantime. */
+	std::mutex helpLock;
+	std::condition_variable helpWanted;
+	std::condition_variable partsDone;
+	bool sourceBusy;
+	std::deque<SharedEvaluation *> shared;
+
+	/* The number of workers waiting for the job source or for the other
+	 * workers to finish, and the number of them out of jobs for good. */
+	int idle;
+	int exhausted;
+
+	bool refill(WorkerThread&);
+	bool steal(WorkerThread&);
+	bool work(SharedEvaluation *);
+	bool linger(void);
+	int parts(Parameters&, int);
+
+public:
+
+	/* The number of candidates rejected for each reason by the workers of
+	 * every run of this scheduler that has finished. */
+	long rejections[RejectionReasons];
+
+	/* Whether sums recognized by ProductSignature::closedForm go through
+	 * the series arithmetic anyway, to check that it agrees. */
+	bool checkClosedForms;
+
+	void enroll(WorkerThread *);
+	void evaluate(Parameters&, QSeries&);
+	bool nextQueued(WorkerThread&, Parameters&);
+	void run(Catalog *, SeriesStore *, ProductIndex *, int);
+	bool next(WorkerThread&, Parameters&);
+	void record(Parameters&, long);
+	long estimate(Parameters&);
+
+	/* Points to where the jobs come from. */
+	inline JobSource *jobSource(void) {return this->source;}
+
+	Scheduler(JobSource *source)
 	{
-		this->generator = generator;
+		this->source = source;
+
+		for (int index = 0; index < ShapeCount; ++index) {
+			this->costs[index] = 0;
+			this->seriesCosts[0][index] = 0;
+			this->seriesCosts[1][index] = 0;
+		}
 
-		/* The amount of memory this class can take up if new is not used here
-		 * may cause a stack overflow. */
-		for (int index = 0; index < JobQueueLimit; ++index) {
-			jobQueue[index] = new Parameters();
+		this->checkClosedForms = false;
+		this->sourceBusy = false;
+		this->idle = 0;
+		this->exhausted = 0;
+
+		for (int index = 0; index < RejectionReasons; ++index) {
+			this->rejections[index] = 0;
 		}
 	}
+};
+
+/* Serves requests to try specific parameter combinations, read one per line
+ * in the format of Parameters::read from standard input or from clients of
+ * a Unix socket, answering each with the line of the request followed by a
+ * colon and the product signature found, as written by
+ * ProductSignature::write. The worker threads, the series store and the
+ * scheduler's cost estimates stay in place between requests. Answers are
+ * written as soon as they are ready, so they may come out of order. Socket
+ * clients are served one at a time, each until it closes its end. Requests
+ * are never rejected early the way the search rejects hopeless parameters,
+ * so every answer is the signature factorized from the $q$-series, which is
+ * 0 only if it has no product pattern. */
+class Daemon : public JobSource
+{
+	/* The file descriptors requests are read from and answers written to,
+	 * and the listening socket, or -1 when reading standard input. */
+	int input;
+	int output;
+	int listener;
+
+	/* Input read but not yet parsed into requests. */
+	std::string buffer;
+
+	/* Must be held while writing an answer. */
+	std::mutex outputLock;
+
+	/* The number of requests given out but not answered yet, with a
+	 * condition signalled whenever it drops to zero. */
+	long outstanding;
+	std::condition_variable allAnswered;
+
+	bool readLine(std::string&, bool);
+	void answer(const std::string&);
+
+public:
+	bool listen(const char *);
+	int populate(std::deque<Parameters>&, int) override;
+	int nextShape(void) override;
+	void finish(WorkerThread&, Parameters&, ProductSignature&, bool,
+				long) override;
+	bool rejectsEarly(void) override {return false;}
+
+	Daemon(void)
+	{
+		this->input = 0;
+		this->output = 1;
+		this->listener = -1;
+		this->outstanding = 0;
+	}
+
+	~Daemon(void);
+};
+
+/* Measures the throughput of the search on fixed slices of the order of the
+ * parameter generator, each a named run of combinations of one shape within
+ * fixed bounds, using BenchmarkThreadsToUse worker threads. Each slice is reported on one line
+ * as its name, the candidates tried, the identities found, the seconds
+ * taken and the candidates tried per second, followed by the thread seconds
+ * spent computing $q$-series, factorizing them and writing identities out.
+ * Those lines can be saved as a baseline for later runs to be compared
+ * against. */
+class Benchmark : public JobSource
+{
+	/* Gives out the combinations of the slice being run. */
+	ParameterGenerator generator;
+
+	/* Combinations of the slice not given out yet. */
+	long remaining;
+
+	/* Must be held while adding to the results. */
+	std::mutex resultsLock;
+
+	/* Results of the slice being run, with times in nanoseconds summed over
+	 * every worker thread. */
+	long candidates;
+	long hits;
+	long seriesNanoseconds;
+	long factorizeNanoseconds;
+	long outputNanoseconds;
+
+public:
+	int populate(std::deque<Parameters>&, int) override;
+	int nextShape(void) override;
+	void finish(WorkerThread&, Parameters&, ProductSignature&, bool,
+				long) override;
+	int run(const char *, const char *, Catalog *, SeriesStore *,
+			ProductIndex *);
+
+	Benchmark(void)
+	{
+		this->remaining = 0;
+		this->candidates = 0;
+		this->hits = 0;
+		this->seriesNanoseconds = 0;
+		this->factorizeNanoseconds = 0;
+		this->outputNanoseconds = 0;
+	}
+};
+
+/* Checks the fast paths of the arithmetic against the plain code they stand
+ * in for, on random inputs. The specialized kernels, whole and split into
+ * parts, are checked against qSeries, factorizeBatch against factorize, and
+ * applyQPochhammer and applyQBinomial against building the factor with
+ * qPochhammer, raiseToPower and reciprocal and multiplying by it. The first
+ * case where they disagree is shrunk one step at a time for as long as they
+ * still disagree, and then written out. */
+class Fuzzer
+{
+	/* A single check, of the kind given by one of the constants in
+	 * Fuzzer.cpp, on parameters, integer arguments and series as the kind
+	 * needs them. */
+	class Case
+	{
+	public:
+		int kind;
+		Parameters parameters;
+		int arguments[5];
+		std::vector<QSeries> series;
+	};
+
+	std::mt19937_64 random;
+
+	int uniform(int, int);
+	Parameters randomParameters(int);
+	QSeries randomSeries(int);
+	Case randomCase(bool);
+	std::string check(Case&);
+	void shrink(Case&);
+	void write(Case&, std::ostream&);
+
+public:
+	bool run(long);
+};
+
+/* Estimates the cost and yield of searching every combination the parameter
+ * generator gives out, by trying a uniform random sample of the runs of
+ * SampledRunLength consecutive combinations into which each shape is cut,
+ * without replacement. For each shape it reports
+ * the number of combinations, the number sampled, and the mean time to try
+ * one and the fraction that give identities, each with a 95% confidence
+ * interval. The totals extrapolated from them follow, again with 95%
+ * confidence intervals. Shapes small enough are tried in full, and their
+ * results are exact. */
+class Sampler : public JobSource
+{
+	/* Decodes the sampled positions into combinations, of which those the
+	 * excluded generator gives out are left out, unless it is nullptr. */
+	ParameterGenerator generator;
+	ParameterGenerator *excluded;
+
+	/* A run of consecutive combinations sampled together: its shape, the
+	 * combinations of it tried, how many of them gave identities, and the
+	 * nanoseconds they took. */
+	struct Run {
+		int shape;
+		long tried;
+		long hits;
+		double nanoseconds;
+	};
+
+	/* The sampled combinations, run after run, the number of them in each
+	 * run, and the numbers of both given out so far. */
+	std::deque<Parameters> jobs;
+	std::vector<long> lengths;
+	std::size_t given;
+	std::size_t givenRuns;
+
+	/* Must be held while adding to the results. */
+	std::mutex resultsLock;
+
+	/* Every run sampled, by the position of its first combination. */
+	std::map<long, Run> runs;
+
+	/* Results for each shape: the combinations tried, how many of them gave
+	 * identities, and the nanoseconds they took. */
+	long tried[ShapeCount];
+	long hits[ShapeCount];
+	double nanoseconds[ShapeCount];
+
+public:
+	int populate(std::deque<Parameters>&, int) override;
+	int nextShape(void) override;
+	void finish(WorkerThread&, Parameters&, ProductSignature&, bool,
+				long) override;
+	void bound(const SearchBounds&, ParameterGenerator *);
+	void run(long, Catalog *, SeriesStore *, ProductIndex *);
+
+	Sampler(void)
+	{
+		this->excluded = nullptr;
+		this->given = 0;
+		this->givenRuns = 0;
+
+		for (int index = 0; index < ShapeCount; ++index) {
+			this->tried[index] = 0;
+			this->hits[index] = 0;
+			this->nanoseconds[index] = 0;
+		}
+	}
+};
+
+/* Searches the combinations the parameter generator gives out in the order
+ * most likely to give identities soon, for runs with a fixed time budget.
+ * The combinations are split into regions, each the run of combinations of
+ * a shape that share the dilation of the $q$-binomial factor and the last
+ * $q$-Pochhammer symbol. Every region is probed once, and after that the
+ * region with the highest upper confidence bound on its identities per CPU
+ * second is given out from, a little more of it each time it is picked.
+ * The search stops giving out combinations at the deadline, and the
+ * combinations given out in each region, together with its results, can be
+ * saved to a progress file and loaded from it to resume the search. */
+class AnytimeSearch : public JobSource
+{
+	/* A run of combinations in the order of the generator, and the shape
+	 * they have. Of the combinations, given were given out, settled were
+	 * given out before the last time none of them were still being tried,
+	 * and outstanding are still being tried. The results of those tried are
+	 * the number tried, the number giving identities, and the nanoseconds
+	 * they took, and the settled results are those of the settled
+	 * combinations alone. */
+	class Region
+	{
+	public:
+		long start;
+		long size;
+		int shape;
+		long given;
+		long settled;
+		long outstanding;
+		long tried;
+		long hits;
+		long nanoseconds;
+		long settledTried;
+		long settledHits;
+		long settledNanoseconds;
+
+		/* Settles every combination given out, once none are still being
+		 * tried. */
+		inline void settle(void)
+		{
+			this->settled = this->given;
+			this->settledTried = this->tried;
+			this->settledHits = this->hits;
+			this->settledNanoseconds = this->nanoseconds;
+		}
+	};
+
+	/* Decodes positions in regions into combinations, of which those the
+	 * excluded generator gives out are skipped, unless it is nullptr. */
+	ParameterGenerator generator;
+	ParameterGenerator *excluded;
+
+	/* Every region, in the order of the generator. */
+	std::vector<Region> regions;
+
+	/* The region being given out from, and the number of its combinations
+	 * left to give out before picking a region again. */
+	int current;
+	long chunk;
+
+	/* The sum of tried over every region. */
+	long tried;
+
+	/* The steady clock times, in nanoseconds, at which to stop giving out
+	 * combinations, or 0 never to stop, and at which to save the progress
+	 * next. */
+	long deadline;
+	long checkpoint;
+
+	/* Where to save the progress, or nullptr not to. */
+	const char *progressPath;
+
+	/* Must be held while using the regions. */
+	std::mutex regionsLock;
+
+	bool pick(void);
+	bool write(void);
+
+public:
+	int populate(std::deque<Parameters>&, int) override;
+	int nextShape(void) override;
+	void finish(WorkerThread&, Parameters&, ProductSignature&, bool,
+				long) override;
+	void bound(const SearchBounds&, ParameterGenerator *);
+	bool load(const char *);
+	bool save(void);
+	void start(long);
+
+	AnytimeSearch(void);
+};
+
+#ifdef BQSPC_TRACE
+
+/* Points in the code timed when tracing, numbering the histograms kept. */
+const static int TraceQSeries = 0;
+const static int TraceQSeriesShape = 1;
+const static int TraceQSeriesTerm = 2;
+const static int TraceApplyQPochhammer = 3;
+const static int TraceQPochhammer = 4;
+const static int TraceRaiseToPower = 5;
+const static int TraceReciprocal = 6;
+const static int TraceFactorize = 7;
+const static int TraceVerify = 8;
+const static int TracePoints = 9;
+
+/* Number of histogram buckets, the $k$th counting the calls that took
+ * from $2^k$ up to $2^{k+1}$ cycles. */
+const static int TraceBuckets = 48;
+
+/* The deepest nesting of timed calls kept apart in the folded stacks, each
+ * frame taking 4 bits of the stack key. Deeper calls are counted as part of
+ * the call they are in. */
+const static int TraceDepth = 8;
+
+/* Reads a cycle counter, or the nanoseconds of a steady clock where there
+ * is none. */
+inline unsigned long traceCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/* The timings recorded by one thread when tracing. Each thread gets its own
+ * log on first use, so recording takes no locks, and every log is kept
+ * until the program exits, when they are added up and written out. */
+class TraceLog
+{
+	friend class TraceScope;
+
+	/* The number of calls to each timed point from a job of each shape, by
+	 * the logarithm of the cycles they took, and the total cycles. */
+	long histograms[ShapeCount][TracePoints][TraceBuckets];
+	long cycles[ShapeCount][TracePoints];
+
+	/* The cycles spent in each stack of timed calls, leaving out the calls
+	 * timed within them, keyed by the shape and then a frame per call. */
+	std::unordered_map<long, long> stacks;
+
+	/* The stack of calls being timed, its depth, and the cycles taken by
+	 * the calls timed within each of them. */
+	long stack;
+	int depth;
+	unsigned long nested[TraceDepth];
+
+public:
+
+	/* The shape of the job the thread is trying. */
+	int shape;
+
+	static TraceLog& local(void);
+	static void dump(void);
+
+	TraceLog(void) : histograms(), cycles(), nested()
+	{
+		this->stack = 0;
+		this->depth = 0;
+		this->shape = 0;
+	}
+};
+
+/* Times the rest of the scope it is declared in as a call to a point. */
+class TraceScope
+{
+	TraceLog *log;
+	int point;
+	int level;
+	unsigned long start;
+
+public:
+	TraceScope(int point)
+	{
+		this->log = &TraceLog::local();
+		this->point = point;
+		this->level = this->log->depth++;
+
+		if (this->level < TraceDepth) {
+			this->log->nested[this->level] = 0;
+			this->log->stack = this->log->stack * 16 + point + 1;
+		}
+
+		this->start = traceCycles();
+	}
+
+	~TraceScope(void)
+	{
+		unsigned long elapsed = traceCycles() - this->start;
+		int shape = this->log->shape;
+
+		this->log->depth--;
+		this->log->histograms[shape][this->point]
+							 [63 - __builtin_clzl(elapsed | 1)]++;
+		this->log->cycles[shape][this->point] += elapsed;
+
+		if (this->level < TraceDepth) {
+			this->log->stacks[static_cast<long>(shape) << 32
+							  | this->log->stack]
+				+= elapsed - this->log->nested[this->level];
+			this->log->stack /= 16;
+
+			if (this->level > 0) {
+				this->log->nested[this->level - 1] += elapsed;
+			}
+		}
+	}
+};
+
+#define BQSPC_TRACE_SCOPE(point) TraceScope traceScope(point)
+#define BQSPC_TRACE_SHAPE(value) TraceLog::local().shape = (value)
+
+#else
+
+#define BQSPC_TRACE_SCOPE(point)
+#define BQSPC_TRACE_SHAPE(value)
+
+#endif
+
+/* Data and methods for each worker thread. */
+class WorkerThread
+{
+	friend class Benchmark;
+	friend class Scheduler;
+
+	/* Points to the scheduler handing out jobs. */
+	Scheduler *scheduler;
+
+	/* Points to the known identities to suppress, or is nullptr. */
+	Catalog *catalog;
+
+	/* Points to the persistent store of computed series, or is nullptr. */
+	SeriesStore *store;
+
+	/* Points to the products to match series against instead of factorizing
+	 * them, or is nullptr. */
+	ProductIndex *index;
+
+	/* Parameters waiting to be tried, taken from the front by this worker
+	 * and from the back by others stealing work. */
+	std::deque<Parameters> jobQueue;
+
+	/* Must be held whenever the job queue is accessed. */
+	std::mutex jobQueueLock;
+
+	/* Nanoseconds the last job finished spent computing $q$-series and
+	 * factorizing them, respectively. */
+	long seriesNanoseconds;
+	long factorizeNanoseconds;
+
+	/* The number of candidates this worker rejected for each reason. */
+	long rejections[RejectionReasons];
+
+	/* A job being tried, with what has been found about it so far: its
+	 * $q$-series, its product signature, the signature and support GCD of
+	 * its closed form, whether the signature was taken from the closed
+	 * form, whether it is still a candidate, and the nanoseconds spent on
+	 * it in total and in each stage. */
+	class Attempt
+	{
+	public:
+		Parameters parameters;
+		QSeries candidate;
+		ProductSignature signature;
+		ProductSignature closedForm;
+		long closedFormGCD;
+		bool recognized;
+		bool pending;
+		long nanoseconds;
+		long seriesNanoseconds;
+		long factorizeNanoseconds;
+	};
+
+	bool prepare(Attempt&);
+	bool conclude(Attempt&);
+	void checkClosedForm(Attempt&, bool);
+
+public:
+	void jobLoop(void);
+	void reportIdentity(Parameters&, ProductSignature&, std::ostream&);
 
-	~WorkerThread(void)
+	WorkerThread(Scheduler *scheduler, Catalog *catalog, SeriesStore *store,
+				 ProductIndex *index)
 	{
-		for (int index = 0; index < JobQueueLimit; ++index) {
-			delete jobQueue[index];
+		this->scheduler = scheduler;
+		this->catalog = catalog;
+		this->store = store;
+		this->index = index;
+		this->seriesNanoseconds = 0;
+		this->factorizeNanoseconds = 0;
+
+		for (int index = 0; index < RejectionReasons; ++index) {
+			this->rejections[index] = 0;
 		}
 	}
 };
@@ -1,85 +1,260 @@
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <thread>
 #include "bqspc.h"
 
-namespace bqspc {
+using namespace bqspc;
 
-/* The number of worker threads to use. */
-const static int WorkerThreadsToUse = 10;
+/* By default, the range of parameters specified at compile time is searched,
+ * and the result is written as a LaTeX file that can immediately be built
+ * into a pdf. The optional arguments are:
+ *
+ * --catalog FILE: known identities in the file are left out of the output.
+ * --store FILE: computed $q$-series are reused and saved there across runs.
+ * --match FILE: only the products in the file, as described for
+ *   ProductIndex::load, are searched for.
+ * --daemon, --daemon-socket PATH: parameters are read from standard input,
+ *   or from clients of a Unix socket at the path, as described for Daemon.
+ * --benchmark SLICE, --baseline FILE: the throughput on the slice, or on all
+ *   of them, is measured and compared with the results saved in the file,
+ *   as described for Benchmark.
+ * --sample N: about N combinations of each shape are tried at random to
+ *   estimate the cost and yield of the search, as described for Sampler.
+ * --fuzz N: the fast arithmetic is checked against the plain code on N
+ *   random cases, or until one disagrees if N is 0, as described for Fuzzer.
+ * --anytime SECONDS, --progress FILE: the likeliest combinations are
+ *   searched first, stopping after that many seconds unless it is 0, with
+ *   progress resumed from and saved to the file, as described for
+ *   AnytimeSearch.
+ * --bounds LIST, --delta LIST: the bounds in the list, as described for
+ *   SearchBounds::read, are searched instead of the built in ones, leaving
+ *   out the combinations within the --delta bounds, in the search, sampling
+ *   and the anytime search.
+ * --check-closed-forms: sums whose product is known in closed form, which
+ *   are otherwise settled from it alone, have their $q$-series computed as
+ *   well, and any disagreement is reported, as described for
+ *   ProductSignature::closedForm.
+ *
+ * The daemon, the benchmark, sampling, fuzzing and the anytime search are
+ * modes, of which at most one may be given, each with only its own
+ * options. */
+int main(int argc, char **argv)
+{
+	ParameterGenerator generator;
+	ParameterGenerator searched;
+	SearchBounds bounds;
+	SearchBounds searchedBounds;
+	bool bounded = false;
+	bool delta = false;
+	bool checkClosedForms = false;
+	bool valid = true;
+	int modes;
+	Daemon daemon;
+	Benchmark benchmark;
+	Sampler sampler;
+	long samples = 0;
+	Fuzzer fuzzer;
+	long fuzzCases = -1;
+	AnytimeSearch anytime;
+	long seconds = -1;
+	const char *progress = nullptr;
+	JobSource *source = &generator;
+	const char *slice = nullptr;
+	const char *baseline = nullptr;
+	Catalog catalog;
+	Catalog *catalogInUse = nullptr;
+	SeriesStore store;
+	SeriesStore *storeInUse = nullptr;
+	ProductIndex products;
+	ProductIndex *productsInUse = nullptr;
 
-extern long *precomputedDivisorList[MaxSeriesLimit];
-extern int precomputedDivisorFunction[MaxSeriesLimit];
+	for (int index = 1; index < argc; ++index) {
+		if (std::strcmp(argv[index], "--catalog") == 0 && index + 1 < argc) {
+			if (!catalog.load(argv[++index])) return 1;
 
-};
+			catalogInUse = &catalog;
+		} else if (std::strcmp(argv[index], "--store") == 0
+				   && index + 1 < argc) {
 
-using namespace bqspc;
+			if (!store.open(argv[++index])) return 1;
 
-static void workerThreadEntry(ParameterGenerator *generator)
-{
-	WorkerThread worker(generator);
+			storeInUse = &store;
+		} else if (std::strcmp(argv[index], "--match") == 0
+				   && index + 1 < argc) {
 
-	worker.jobLoop();
-}
+			if (!products.load(argv[++index])) return 1;
 
-/* No arguments are parsed. The range of parameters used must be specified at
- * compile time for now. The result will be written in the format of a LaTeX
- * file that can immediately be built into a pdf without extra work. */
-int main(void)
-{
-	ParameterGenerator generator;
-	std::thread threads[WorkerThreadsToUse];
+			productsInUse = &products;
+		} else if (std::strcmp(argv[index], "--daemon") == 0) {
+			source = &daemon;
+		} else if (std::strcmp(argv[index], "--daemon-socket") == 0
+				   && index + 1 < argc) {
+
+			if (!daemon.listen(argv[++index])) return 1;
+
+			source = &daemon;
+		} else if (std::strcmp(argv[index], "--benchmark") == 0
+				   && index + 1 < argc) {
+
+			slice = argv[++index];
+		} else if (std::strcmp(argv[index], "--baseline") == 0
+				   && index + 1 < argc) {
 
-	/* Populate the precomputed divisors using a brute force algorithm since
-	 * this is only done once, and does not benefit from extra efficiency. */
-	precomputedDivisorFunction[0] = 0;
-	precomputedDivisorList[0] = nullptr;
+			baseline = argv[++index];
+		} else if (std::strcmp(argv[index], "--sample") == 0
+				   && index + 1 < argc) {
 
-	for (long nIndex = 1; nIndex < MaxSeriesLimit; ++nIndex) {
-		long buffer[MaxSeriesLimit];
-		int length = 0;
+			samples = std::atol(argv[++index]);
 
-		/* Fill the buffer with every value that divides nIndex. */
-		for (long kIndex = 1; kIndex <= nIndex / 2; ++kIndex) {
-			if (nIndex % kIndex == 0) {
-				buffer[length++] = kIndex;
+			if (samples <= 0) {
+				std::cerr << "The number of samples must be positive.\n";
+				return 1;
 			}
-		}
+		} else if (std::strcmp(argv[index], "--fuzz") == 0
+				   && index + 1 < argc) {
+
+			fuzzCases = std::atol(argv[++index]);
+
+			if (fuzzCases < 0) {
+				std::cerr << "The number of cases must not be negative.\n";
+				return 1;
+			}
+		} else if (std::strcmp(argv[index], "--anytime") == 0
+				   && index + 1 < argc) {
+
+			seconds = std::atol(argv[++index]);
+			source = &anytime;
 
-		buffer[length++] = nIndex;
+			if (seconds < 0) {
+				std::cerr << "The number of seconds must not be negative.\n";
+				return 1;
+			}
+		} else if (std::strcmp(argv[index], "--progress") == 0
+				   && index + 1 < argc) {
 
-		/* Create the next entry in the divisor list and copy the divisors
-		 * over, and save the value of the divisor function. */
-		precomputedDivisorList[nIndex] = new long[length];
+			progress = argv[++index];
+		} else if (std::strcmp(argv[index], "--bounds") == 0
+				   && index + 1 < argc) {
 
-		for (int kIndex = 0; kIndex < length; ++kIndex) {
-			precomputedDivisorList[nIndex][kIndex] = buffer[kIndex];
+			if (!bounds.read(argv[++index])) return 1;
+
+			bounded = true;
+		} else if (std::strcmp(argv[index], "--delta") == 0
+				   && index + 1 < argc) {
+
+			if (!searchedBounds.read(argv[++index])) return 1;
+
+			delta = true;
+		} else if (std::strcmp(argv[index], "--check-closed-forms") == 0) {
+			checkClosedForms = true;
+		} else {
+			valid = false;
+			break;
 		}
+	}
+
+	/* At most one mode may be chosen, with only its own options, and the
+	 * bounds only apply to the modes that search the generator's order. */
+	modes = (source == &daemon) + (slice != nullptr) + (samples > 0)
+		  + (fuzzCases >= 0) + (source == &anytime);
 
-		precomputedDivisorFunction[nIndex] = length;
+	if (!valid || modes > 1 || (baseline != nullptr && slice == nullptr)
+		|| (progress != nullptr && source != &anytime)
+		|| ((bounded || delta) && (source == &daemon || slice != nullptr
+								   || fuzzCases >= 0))) {
+
+		std::cerr << "Usage: " << argv[0] << " [--catalog FILE] "
+					 "[--store FILE] [--match FILE] [--daemon | "
+					 "--daemon-socket PATH | --benchmark SLICE "
+					 "[--baseline FILE] | --fuzz N | [--sample N | "
+					 "--anytime SECONDS [--progress FILE]] "
+					 "[--bounds LIST] [--delta LIST]] "
+					 "[--check-closed-forms]\n";
+		return 1;
 	}
 
-	/* Header for the LaTeX output. */
-	std::cout << "\\documentclass{article}\n"\
-				 "\\usepackage[margin=1in]{geometry}\n"\
-				 "\\begin{document}\n\n";
+	generator = ParameterGenerator(bounds);
+
+	if (delta) {
+		searched = ParameterGenerator(searchedBounds);
+		generator.exclude(&searched);
+	}
 
-	/* Create the worker threads. */
-	for (int index = 0; index < WorkerThreadsToUse; ++index) {
-		threads[index] = std::thread(workerThreadEntry, &generator);
+	if (slice != nullptr) {
+		return benchmark.run(slice, baseline, catalogInUse, storeInUse,
+							 productsInUse);
 	}
 
-	/* Cleanup. */
-	for (int index = 0; index < WorkerThreadsToUse; ++index) {
-		threads[index].join();
+	if (fuzzCases >= 0) {
+		return fuzzer.run(fuzzCases) ? 0 : 1;
 	}
 
-	for (int index = 1; index < MaxSeriesLimit; ++index) {
-		delete precomputedDivisorList[index];
+	if (samples > 0) {
+		sampler.bound(bounds, delta ? &searched : nullptr);
+		sampler.run(samples, catalogInUse, storeInUse, productsInUse);
+		return 0;
 	}
 
-	/* Footer for the LaTeX output. */
-	std::cout << "\\end{document}\n";
+	if (source == &anytime) {
+		anytime.bound(bounds, delta ? &searched : nullptr);
+
+		if (progress != nullptr && !anytime.load(progress)) return 1;
+
+		anytime.start(seconds);
+	}
+
+	Scheduler scheduler(source);
+
+	scheduler.checkClosedForms = checkClosedForms;
+
+	if (source == &daemon) {
+		scheduler.run(catalogInUse, storeInUse, productsInUse,
+					  WorkerThreadsToUse);
+	} else {
+
+		/* Header for the LaTeX output. */
+		std::cout << "\\documentclass{article}\n"\
+					 "\\usepackage[margin=1in]{geometry}\n"\
+					 "\\begin{document}\n\n";
+
+		scheduler.run(catalogInUse, storeInUse, productsInUse,
+					  WorkerThreadsToUse);
+
+		/* Footer for the LaTeX output. */
+		std::cout << "% Candidates rejected: "
+				  << scheduler.rejections[RejectedFlatAxis]
+				  << " with an index not raising the power of q, "
+				  << scheduler.rejections[RejectedDilatedParameters]
+				  << " with parameters in a power of q,\n% "
+				  << scheduler.rejections[RejectedDilatedSeries]
+				  << " with a series in a power of q, "
+				  << scheduler.rejections[RejectedNoPattern]
+				  << " without a product pattern, "
+				  << scheduler.rejections[RejectedDilatedProduct]
+				  << " with a dilated product,\n% "
+				  << scheduler.rejections[RejectedUnverified]
+				  << " failing verification.\n";
+
+		if (productsInUse != nullptr) {
+			std::cout << "% " << scheduler.rejections[RejectedNoMatch]
+					  << " candidates did not match any of the "
+					  << products.size() << " products searched for.\n";
+		}
+
+		if (catalogInUse != nullptr) {
+			std::cout << "% " << catalog.matches << " identities found in "
+						 "the catalog were not shown.\n";
+		}
+
+		if (delta) {
+			std::cout << "% Combinations within the bounds searched before "
+						 "were left out.\n";
+		}
+
+		std::cout << "\\end{document}\n";
+
+		if (source == &anytime && !anytime.save()) return 1;
+	}
 
 	return 0;
 }
-